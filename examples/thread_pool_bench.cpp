@@ -0,0 +1,92 @@
+#include <rnu/thread_pool.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Counts global allocations to show which submission paths allocate per task.
+static std::atomic_size_t allocation_count = 0;
+
+void* operator new(size_t size)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (auto* const memory = std::malloc(size == 0 ? 1 : size))
+    return memory;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+  std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+  std::free(memory);
+}
+
+template<typename Submit>
+void measure(char const* name, rnu::thread_pool& pool, size_t count, Submit&& submit)
+{
+  // Warm up the node pools so only steady state allocations are counted.
+  submit(pool, count);
+
+  auto const allocations = allocation_count.load();
+  auto const start = std::chrono::steady_clock::now();
+  submit(pool, count);
+  auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  auto const allocated = allocation_count.load() - allocations;
+
+  std::printf("%-14s %-13s %12.0f tasks/s %8.2f allocations/task\n", name,
+    pool.mode() == rnu::thread_pool_mode::work_stealing ? "work_stealing" : "shared_queue",
+    count / seconds, double(allocated) / count);
+}
+
+int main(int argc, char** argv)
+{
+  size_t const count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+  for (auto const mode : { rnu::thread_pool_mode::shared_queue, rnu::thread_pool_mode::work_stealing })
+  {
+    rnu::thread_pool pool(std::thread::hardware_concurrency(), mode);
+
+    std::vector<std::future<int>> futures;
+    futures.reserve(count);
+    measure("run_async", pool, count, [&](rnu::thread_pool& p, size_t n) {
+      futures.clear();
+      for (size_t i = 0; i < n; ++i)
+        futures.push_back(p.run_async<int>([i] { return int(i); }));
+      for (auto& f : futures)
+        f.get();
+    });
+
+    std::vector<rnu::job_future<int>> job_futures;
+    job_futures.reserve(count);
+    measure("submit", pool, count, [&](rnu::thread_pool& p, size_t n) {
+      job_futures.clear();
+      for (size_t i = 0; i < n; ++i)
+        job_futures.push_back(p.submit([i] { return int(i); }));
+      for (auto& f : job_futures)
+        f.get();
+    });
+
+    measure("run_detached", pool, count, [&](rnu::thread_pool& p, size_t n) {
+      std::atomic_size_t done = 0;
+      for (size_t i = 0; i < n; ++i)
+        p.run_detached([&done] { done.fetch_add(1, std::memory_order_release); });
+      while (done.load(std::memory_order_acquire) != n)
+        p.try_run_one();
+    });
+
+    std::vector<std::function<void()>> batch;
+    measure("run_many", pool, count, [&](rnu::thread_pool& p, size_t n) {
+      std::atomic_size_t done = 0;
+      batch.assign(n, [&done] { done.fetch_add(1, std::memory_order_release); });
+      p.run_many(std::span(batch));
+      while (done.load(std::memory_order_acquire) != n)
+        p.try_run_one();
+    });
+  }
+}
@@ -1,6 +1,11 @@
 #pragma once
+#include "snapshot.hpp"
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace rnu {
@@ -8,25 +13,56 @@ enum class id_t : uint64_t {};
 struct component_base;
 using entity_handle = void*;
 constexpr const entity_handle null_entity = nullptr;
-using component_creator_fun = ptrdiff_t (*)(
-    std::vector<std::byte>& memory, entity_handle entity, const component_base* base_component);
+using component_creator_fun = component_base* (*)(void* memory, entity_handle entity, const component_base* base_component);
 using component_deleter_fun = void (*)(component_base* base_component);
+// Moves "count" components from src into the uninitialized memory at dst and destroys the sources.
+using component_relocate_fun = void (*)(void* dst, component_base* src, size_t count);
+using component_save_fun = void (*)(const component_base* component, snapshot_writer& writer);
+// Constructs a component at "memory" from the reader.
+using component_load_fun = void (*)(void* memory, snapshot_reader& reader);
+
+namespace traits {
+  // Specialize for component types that can be moved with memcpy despite not being trivially copyable.
+  template <typename T> struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+} // namespace traits
+
+struct component_type_info {
+  component_creator_fun creator;
+  component_deleter_fun deleter;
+  component_relocate_fun relocator;
+  // Only set for types with a component_serializer, trivially copyable types are snapshot as raw bytes.
+  component_save_fun saver;
+  component_load_fun loader;
+  size_t size;
+  size_t alignment;
+  bool trivially_relocatable;
+  bool trivially_copyable;
+};
 
 struct component_base {
   entity_handle entity = null_entity;
 
+  static const component_type_info& type_info(id_t id) {
+    return types()[static_cast<size_t>(id)];
+  }
   static auto get_creator(id_t id) {
-    return std::get<component_creator_fun>(types()[static_cast<size_t>(id)]);
+    return type_info(id).creator;
   }
   static auto get_deleter(id_t id) {
-    return std::get<component_deleter_fun>(types()[static_cast<size_t>(id)]);
+    return type_info(id).deleter;
+  }
+  static auto get_relocator(id_t id) {
+    return type_info(id).relocator;
   }
   static size_t type_size(id_t id) {
-    return std::get<size_t>(types()[static_cast<size_t>(id)]);
+    return type_info(id).size;
   }
   static bool is_valid(id_t id) {
     return static_cast<size_t>(id) < types().size();
   }
+  static size_t type_count() {
+    return types().size();
+  }
 
   template <typename T> T& as() {
     return static_cast<std::decay_t<T>&>(*this);
@@ -42,23 +78,21 @@ struct component_base {
   }
 
 protected:
-  static id_t register_type(component_creator_fun create, component_deleter_fun deleter, size_t size) {
+  static id_t register_type(const component_type_info& info) {
     const id_t id{types().size()};
-    types().emplace_back(create, deleter, size);
+    types().push_back(info);
     return id;
   }
 
 private:
-  static auto types()->std::vector<std::tuple<component_creator_fun, component_deleter_fun, size_t>>&;
+  static auto types() -> std::vector<component_type_info>&;
 };
 
 template <typename C>
-ptrdiff_t create(std::vector<std::byte>& memory, entity_handle entity, const component_base* base_component) {
-  const ptrdiff_t ptr = memory.size();
-  memory.resize(memory.size() + C::size);
-  C* component = new (&memory[ptr]) C(*static_cast<const C*>(base_component));
+component_base* create(void* memory, entity_handle entity, const component_base* base_component) {
+  C* component = new (memory) C(*static_cast<const C*>(base_component));
   component->entity = entity;
-  return ptr;
+  return component;
 }
 
 template <typename C> void destroy(component_base* base_component) {
@@ -66,6 +100,38 @@ template <typename C> void destroy(component_base* base_component) {
   component->~C();
 }
 
+template <typename C> void relocate(void* dst, component_base* src, size_t count) {
+  C* const to = static_cast<C*>(dst);
+  C* const from = static_cast<C*>(src);
+  if constexpr (traits::is_trivially_relocatable<C>::value) {
+    if (count != 0)
+      std::memmove(static_cast<void*>(to), static_cast<const void*>(from), count * sizeof(C));
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      new (to + i) C(std::move(from[i]));
+      from[i].~C();
+    }
+  }
+}
+
+template <typename C> void save_component(const component_base* base_component, snapshot_writer& writer) {
+  component_serializer<C>::save(*static_cast<const C*>(base_component), writer);
+}
+
+template <typename C> void load_component(void* memory, snapshot_reader& reader) {
+  new (memory) C(component_serializer<C>::load(reader));
+}
+
+template <typename C> component_type_info make_type_info() {
+  component_type_info info{create<C>, destroy<C>, relocate<C>, nullptr, nullptr, sizeof(C), alignof(C),
+      traits::is_trivially_relocatable<C>::value, std::is_trivially_copyable_v<C>};
+  if constexpr (traits::has_component_serializer<C>) {
+    info.saver = save_component<C>;
+    info.loader = load_component<C>;
+  }
+  return info;
+}
+
 template <typename T> struct component : component_base {
   using type = T;
 
@@ -73,12 +139,14 @@ template <typename T> struct component : component_base {
   static const id_t id;
   static const component_creator_fun creator;
   static const component_deleter_fun deleter;
+  static const component_relocate_fun relocator;
 };
 
 template <typename T> const size_t component<T>::size = sizeof(T);
-template <typename T> const id_t component<T>::id = register_type(create<T>, destroy<T>, size);
+template <typename T> const id_t component<T>::id = register_type(make_type_info<T>());
 template <typename T> const component_creator_fun component<T>::creator = create<T>;
 template <typename T> const component_deleter_fun component<T>::deleter = destroy<T>;
+template <typename T> const component_relocate_fun component<T>::relocator = relocate<T>;
 
 template <typename T> struct simple_component : component<simple_component<T>>, T { using T::T; };
 
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "component.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <vector>
+
+namespace rnu {
+// Sparse set of all components of one type.
+// Components live densely packed in "dense", "sparse" maps an entity index to the element index in "dense".
+// "ticks" runs parallel to "dense" and holds the ecs change tick of the last mutable access per component.
+// The first "sorted_count" elements are known to be ordered by the ordering last used to sort the storage.
+class component_storage {
+public:
+  static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+  explicit component_storage(id_t type) : _type(component_base::type_info(type)) {}
+  component_storage(const component_storage& other) = delete;
+  component_storage(component_storage&& other) noexcept
+      : _type(other._type), _dense(std::exchange(other._dense, nullptr)), _size(std::exchange(other._size, 0)),
+        _capacity(std::exchange(other._capacity, 0)), _sparse(std::move(other._sparse)),
+        _ticks(std::move(other._ticks)), _scratch(std::exchange(other._scratch, nullptr)),
+        _sorted_order(other._sorted_order), _sorted_count(std::exchange(other._sorted_count, 0)) {}
+  component_storage& operator=(const component_storage& other) = delete;
+  component_storage& operator=(component_storage&& other) noexcept {
+    if (this != &other) {
+      clear();
+      deallocate(_dense);
+      deallocate(_scratch);
+      _type = other._type;
+      _dense = std::exchange(other._dense, nullptr);
+      _size = std::exchange(other._size, 0);
+      _capacity = std::exchange(other._capacity, 0);
+      _sparse = std::move(other._sparse);
+      _ticks = std::move(other._ticks);
+      _scratch = std::exchange(other._scratch, nullptr);
+      _sorted_order = other._sorted_order;
+      _sorted_count = std::exchange(other._sorted_count, 0);
+    }
+    return *this;
+  }
+  ~component_storage() {
+    clear();
+    deallocate(_dense);
+    deallocate(_scratch);
+  }
+
+  size_t element_size() const noexcept {
+    return _type.size;
+  }
+  size_t size() const noexcept {
+    return _size;
+  }
+  size_t capacity() const noexcept {
+    return _capacity;
+  }
+  bool empty() const noexcept {
+    return _size == 0;
+  }
+
+  uint32_t index_of(uint32_t entity_index) const noexcept {
+    return entity_index < _sparse.size() ? _sparse[entity_index] : npos;
+  }
+  bool contains(uint32_t entity_index) const noexcept {
+    return index_of(entity_index) != npos;
+  }
+
+  component_base* at(uint32_t element) noexcept {
+    return reinterpret_cast<component_base*>(_dense + element * _type.size);
+  }
+  const component_base* at(uint32_t element) const noexcept {
+    return reinterpret_cast<const component_base*>(_dense + element * _type.size);
+  }
+  component_base* find(uint32_t entity_index) noexcept {
+    const auto element = index_of(entity_index);
+    return element == npos ? nullptr : at(element);
+  }
+  const component_base* find(uint32_t entity_index) const noexcept {
+    const auto element = index_of(entity_index);
+    return element == npos ? nullptr : at(element);
+  }
+
+  void link(uint32_t entity_index, uint32_t element) {
+    if (entity_index >= _sparse.size())
+      _sparse.resize(entity_index + 1, npos);
+    _sparse[entity_index] = element;
+  }
+  void unlink(uint32_t entity_index) noexcept {
+    _sparse[entity_index] = npos;
+  }
+  void relink(uint32_t from_entity_index, uint32_t to_entity_index) {
+    const auto element = _sparse[from_entity_index];
+    unlink(from_entity_index);
+    link(to_entity_index, element);
+    limit_sorted_count(element);
+  }
+
+  uint32_t changed_tick(uint32_t element) const noexcept {
+    return _ticks[element];
+  }
+  // Called on every mutable access, the value may change its position in any ordering.
+  void set_changed_tick(uint32_t element, uint32_t tick) noexcept {
+    _ticks[element] = tick;
+    limit_sorted_count(element);
+  }
+  // Only writes the tick, so writers of distinct elements can run concurrently. They have to lower the sorted range
+  // with limit_sorted_count themselves.
+  void write_changed_tick(uint32_t element, uint32_t tick) noexcept {
+    _ticks[element] = tick;
+  }
+
+  // Grows the dense array to hold at least "count" components, relocating existing ones.
+  void reserve(size_t count) {
+    if (count <= _capacity)
+      return;
+    const auto memory = allocate(count);
+    _type.relocator(memory, at(0), _size);
+    deallocate(_dense);
+    _dense = memory;
+    _capacity = count;
+    _ticks.reserve(count);
+  }
+
+  // Copy-constructs a component at the end of the dense array and links it to the entity.
+  uint32_t emplace(uint32_t entity_index, entity_handle entity, const component_base* prototype, uint32_t tick) {
+    if (_size == _capacity)
+      reserve(std::max<size_t>(8, _capacity * 2));
+    const auto element = static_cast<uint32_t>(_size);
+    _type.creator(_dense + element * _type.size, entity, prototype);
+    ++_size;
+    _ticks.push_back(tick);
+    link(entity_index, element);
+    return element;
+  }
+
+  // Appends "count" unconstructed and unlinked elements and returns the index of the first one.
+  // Used for bulk loading, the caller has to construct the components before anything else touches the storage.
+  uint32_t append_uninitialized(size_t count, uint32_t tick) {
+    reserve(std::max(_size + count, _capacity));
+    const auto first = static_cast<uint32_t>(_size);
+    _size += count;
+    _ticks.resize(_size, tick);
+    return first;
+  }
+
+  // Destroys the component of the entity and moves the last component into its slot.
+  // Returns the component now stored in the vacated slot, or nullptr if it was the last one.
+  component_base* erase(uint32_t entity_index) {
+    const auto element = index_of(entity_index);
+    const auto last = static_cast<uint32_t>(_size - 1);
+    _type.deleter(at(element));
+    unlink(entity_index);
+    _ticks[element] = _ticks[last];
+    _ticks.pop_back();
+    --_size;
+    limit_sorted_count(element);
+    if (element == last)
+      return nullptr;
+    _type.relocator(at(element), at(last), 1);
+    return at(element);
+  }
+
+  // Swaps two elements and their change ticks, the caller has to relink both owners.
+  void swap(uint32_t a, uint32_t b) {
+    if (a == b)
+      return;
+    if (!_scratch)
+      _scratch = allocate(1);
+    _type.relocator(_scratch, at(a), 1);
+    _type.relocator(at(a), at(b), 1);
+    _type.relocator(at(b), reinterpret_cast<component_base*>(_scratch), 1);
+    std::swap(_ticks[a], _ticks[b]);
+  }
+
+  // "order" identifies the ordering, counts for a different ordering are 0. Order 0 is never cached.
+  size_t sorted_count(uintptr_t order) const noexcept {
+    return order != 0 && order == _sorted_order ? _sorted_count : 0;
+  }
+  void set_sorted_count(uintptr_t order, size_t count) noexcept {
+    _sorted_order = order;
+    _sorted_count = order != 0 ? count : 0;
+  }
+  // Keeps the ordering but no more than the first "count" elements in it.
+  void limit_sorted_count(size_t count) noexcept {
+    _sorted_count = std::min(_sorted_count, count);
+  }
+
+  void clear() noexcept {
+    for (auto i = 0u; i < _size; ++i) _type.deleter(at(i));
+    _size = 0;
+    _sparse.clear();
+    _ticks.clear();
+    _sorted_count = 0;
+  }
+
+private:
+  std::byte* allocate(size_t count) const {
+    return static_cast<std::byte*>(::operator new(count * _type.size, std::align_val_t{alignment()}));
+  }
+  void deallocate(std::byte* memory) const noexcept {
+    if (memory)
+      ::operator delete(memory, std::align_val_t{alignment()});
+  }
+  size_t alignment() const noexcept {
+    return std::max(_type.alignment, alignof(std::max_align_t));
+  }
+
+  component_type_info _type;
+  std::byte* _dense = nullptr;
+  size_t _size = 0;
+  size_t _capacity = 0;
+  std::vector<uint32_t> _sparse;
+  std::vector<uint32_t> _ticks;
+  std::byte* _scratch = nullptr;
+  uintptr_t _sorted_order = 0;
+  size_t _sorted_count = 0;
+};
+} // namespace rnu
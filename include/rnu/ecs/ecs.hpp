@@ -1,24 +1,37 @@
 #pragma once
 
+#include "component_storage.hpp"
 #include "entity.hpp"
+#include "events.hpp"
+#include "hierarchy.hpp"
 #include "listener.hpp"
+#include "profiler.hpp"
+#include "shared.hpp"
+#include "snapshot.hpp"
 #include "system.hpp"
+#include "world_view.hpp"
 #include <execution>
-#include <unordered_map>
+#include <expected>
+#include <filesystem>
+#include <memory>
+#include <numeric>
+#include <span>
 #include <cassert>
 #include <chrono>
+#include <deque>
 
 namespace rnu {
 class ecs {
   friend class entity;
+  friend class world_view;
 
 public:
   using duration_type = std::chrono::duration<double>;
 
   ecs() = default;
-  ecs(const ecs& other) = default;
+  ecs(const ecs& other) = delete;
   ecs(ecs&& other) = default;
-  ecs& operator=(const ecs& other) = default;
+  ecs& operator=(const ecs& other) = delete;
   ecs& operator=(ecs&& other) = default;
 
   ~ecs();
@@ -31,6 +44,13 @@ public:
   template <traits::component_type... Components>
   entity create_entity(const Components&... components);
 
+  std::vector<entity> create_entities(
+      size_t count, const component_base** prototypes, const id_t* component_ids, size_t component_count);
+  void delete_entities(std::span<const entity> handles);
+
+  template <traits::component_type... Components>
+  std::vector<entity> create_entities(size_t count, const Components&... prototypes);
+
   unique_entity create_entity_unique(const component_base** components, const id_t* component_ids, size_t count);
 
   template <traits::component_type... Components>
@@ -51,20 +71,149 @@ public:
 
   component_base* get_component(entity_handle handle, id_t cid);
 
+  template <traits::component_type Component> bool has_component(entity_handle handle) const;
+  bool has_component(entity_handle handle, id_t cid) const;
+
+  // Mutable access through entity::get, ecs::get_component and non-const system parameters stamps the component
+  // with the current change tick. Systems using changed<T> skip components not stamped since their last update.
+  uint32_t change_tick() const noexcept;
+  template <traits::component_type Component> void mark_changed(entity_handle handle);
+  void mark_changed(entity_handle handle, id_t cid);
+
+  // Grows the storage of a component type to hold at least "count" components without reallocating.
+  template <traits::component_type Component> void reserve(size_t count);
+  void reserve(id_t cid, size_t count);
+
+  // Reorders the components of one type by "compare(const Component&, const Component&)".
+  // Without a budget the storage is fully sorted. With a budget an insertion sort runs until the budget is used up and
+  // resumes from there on the next call, which is cheap for storages which are already nearly sorted.
+  // Stateless comparators remember the sorted range until components are added, removed or accessed mutably, others
+  // check the whole storage on every call.
+  // Returns true once the storage is sorted.
+  template <traits::component_type Component, typename Compare>
+  bool sort_by(Compare&& compare, duration_type budget = duration_type::max());
+
+  // Reorders all storages by entity, so the components of an entity end up at matching positions in every storage.
+  // Multi-component systems then walk all storages front to back and chunk_systems get longer chunks.
+  // The budget is shared by all storages, returns true once every storage is ordered.
+  bool compact(duration_type budget = duration_type::max());
+
+  // Makes "child" a child of "parent", adding hierarchy components to both if needed. A null parent detaches the child.
+  // Deleting an entity or removing its hierarchy component turns its children into roots.
+  // Returns false and changes nothing if "parent" is "child" or one of its descendants.
+  bool set_parent(entity_handle child, entity_handle parent);
+  entity_handle parent_of(entity_handle handle) const;
+
+  // Visits the Component of every entity in the hierarchy with "fun(Component& child, const Component* parent)".
+  // Parents are visited before their children in a single linear pass over the depth sorted hierarchy storage.
+  // parent is nullptr for roots and for parents without a Component. Typical use is world transform propagation.
+  template <traits::component_type Component, typename Fun> void propagate(Fun&& fun);
+  // Same as above but visits one depth level at a time, each level with the given execution policy.
+  // "fun" must only write to the child.
+  template <traits::component_type Component, typename ExecutionPolicy, typename Fun>
+  requires std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>>
+  void propagate(ExecutionPolicy&& policy, Fun&& fun);
+
+  // World resources are singletons of any type, e.g. a camera, timing or input state. Systems reach them through
+  // system_base::resource<T>() without looking up an entity.
+  template <typename T, typename... Args> T& emplace_resource(Args&&... args);
+  template <typename T> T* resource() noexcept;
+  template <typename T> const T* resource() const noexcept;
+  template <typename T> bool remove_resource();
+
+  // Shared components store each distinct value once. The entity gets a shared<T> component referencing the value,
+  // so entities with equal values, e.g. the same material, share one instance.
+  // Worlds with shared components cannot be saved to snapshots.
+  template <std::equality_comparable T> void set_shared(entity_handle handle, const T& value);
+  template <std::equality_comparable T> const T* get_shared(entity_handle handle) const;
+  template <std::equality_comparable T> bool remove_shared(entity_handle handle);
+  // Calls "fun(const T& value, std::span<const shared<T>> references)" once per distinct value.
+  // References are grouped by sorting the shared<T> storage, each reference holds its entity handle.
+  template <std::equality_comparable T, typename Fun> void for_each_shared(Fun&& fun);
+
+  // Buffered event streams, drained in bulk by any number of event_stream::readers. Besides user defined event types
+  // there are added<T> and removed<T>, which are recorded for component type T once their stream was first requested.
+  // Unlike listener callbacks nothing runs in the middle of structural changes.
+  template <typename Event> event_stream<traits::event_type_t<Event>>& events();
+
+  // Read access for worker threads, see world_view. Creates the storages and locks of all registered component types,
+  // so call it on the owning thread before handing the view out.
+  world_view view();
+
   void update(double delta_seconds, system_list& list);
   void update(duration_type delta, system_list& list);
 
+#ifdef RNU_ECS_PROFILING
+  // Records every following update into the profiler, pass nullptr to stop recording.
+  void set_profiler(ecs_profiler* profiler) noexcept;
+#endif
+
+  // Binary snapshot of all entities and components.
+  // Trivially copyable components are stored as raw, 64 byte aligned arrays and copied back in bulk, other
+  // component types need a component_serializer. Snapshots are only compatible between builds registering the same
+  // component types in the same order. Loading replaces all entities, the file overload memory-maps the snapshot.
+  std::expected<std::vector<std::byte>, snapshot_error> save_snapshot() const;
+  std::expected<void, snapshot_error> save_snapshot(const std::filesystem::path& path) const;
+  std::expected<void, snapshot_error> load_snapshot(std::span<const std::byte> data);
+  std::expected<void, snapshot_error> load_snapshot(const std::filesystem::path& path);
+
 private:
-  std::unordered_map<id_t, std::vector<std::byte>> _components;
+  std::vector<component_storage> _components;
   std::vector<indexed_entity*> _entities;
   std::vector<listener*> _listeners;
-
-  void delete_component(id_t id, size_t index);
+  std::vector<indexed_entity*> _free_entities;
+  uint32_t _tick = 1;
+  size_t _compact_cursor = 0;
+  // Offsets of the first element of each depth level in the hierarchy storage, plus its size.
+  std::vector<uint32_t> _hierarchy_levels;
+  // Indexed by resource_id<T>().
+  std::vector<std::shared_ptr<void>> _resources;
+  // Indexed by the id of the shared<T> component.
+  std::vector<std::unique_ptr<detail::shared_pool_base>> _shared_pools;
+  // Indexed by resource_id<Event>(), the component event streams are also indexed by component id.
+  std::vector<std::unique_ptr<detail::event_stream_base>> _event_streams;
+  std::vector<event_stream<entity_handle>*> _added_events;
+  std::vector<event_stream<entity_handle>*> _removed_events;
+  // One lock per component type, used by world_view readers and writers. Only ever grows, locks held through an
+  // older view stay valid.
+  std::deque<std::shared_mutex> _component_locks;
+#ifdef RNU_ECS_PROFILING
+  ecs_profiler* _profiler = nullptr;
+#endif
+
+  indexed_entity* allocate_entity();
+  void release_entity(uint32_t index);
+  using clock = std::chrono::steady_clock;
+
+  component_storage& storage(id_t id);
+  void swap_components(component_storage& store, uint32_t a, uint32_t b);
+  template <typename Less>
+  bool sort_storage(component_storage& store, uintptr_t order, Less&& less, clock::time_point deadline);
+  static clock::time_point deadline_of(duration_type budget);
+  hierarchy* hierarchy_of(entity_handle handle);
+  void detach(hierarchy& node);
+  void set_depth(entity_handle root, uint32_t depth);
+  void on_hierarchy_removed(uint32_t entity_index);
+  void sort_hierarchy();
+  static size_t next_resource_id() noexcept;
+  template <typename T> static size_t resource_id() noexcept;
+  template <typename T> detail::shared_pool<T>& shared_pool();
+  static event_stream<entity_handle>* component_events(
+      const std::vector<event_stream<entity_handle>*>& streams, id_t id) noexcept;
+  const component_storage* find_storage(id_t id) const noexcept;
+  void delete_component(id_t id, uint32_t entity_index);
   bool remove_component_impl(entity_handle e, id_t component_id);
   void add_component_impl(entity_handle e, id_t component_id, const component_base* component);
-  component_base* get_component_impl(entity_handle e, std::vector<std::byte>& carr, id_t component_id);
-  void update_multi_system(system_base& system, duration_type delta, const std::vector<id_t>& types,
-      std::vector<component_base*>& components, std::vector<std::vector<std::byte>*>& component_arrays);
+  component_base* get_component_impl(entity_handle e, id_t component_id);
+  component_base* access_component_impl(entity_handle e, id_t component_id);
+  size_t update_multi_system(system_base& system, duration_type delta, const std::vector<id_t>& types,
+      std::vector<component_base*>& components, std::vector<component_storage*>& component_arrays);
+  size_t update_chunked_system(system_base& system, duration_type delta, const std::vector<id_t>& types,
+      std::vector<component_base*>& components, std::vector<component_storage*>& component_arrays);
+  ptrdiff_t driving_component(const std::vector<id_t>& types, const std::vector<component_flags>& flags) const;
+
+  static bool listens_to(const listener& l, const entity_info& info);
+  static bool listens_to(const listener& l, id_t component_id);
 
   static indexed_entity* as_entity_ptr(entity_handle handle);
   static uint32_t index_of(entity_handle handle);
@@ -1,6 +1,20 @@
 #pragma once
 
 namespace rnu {
+namespace detail {
+  // The address of this variable is unique per comparator type and identifies the ordering of a storage.
+  template <typename Compare> inline constexpr char sort_order_tag = 0;
+
+  // Only stateless comparators order the same way every time, others like function pointers or capturing lambdas
+  // share their type with different orderings and get order 0, which is never cached.
+  template <typename Compare> uintptr_t sort_order() noexcept {
+    if constexpr (std::is_empty_v<Compare>)
+      return reinterpret_cast<uintptr_t>(&sort_order_tag<Compare>);
+    else
+      return 0;
+  }
+} // namespace detail
+
 template <traits::component_type... Component> void entity::add(const Component&... component) {
   (_ecs->add_component_impl(_handle, Component::id, &component), ...);
 }
@@ -12,14 +26,17 @@ template <traits::component_type Component, traits::component_type... Components
 
 template <traits::component_type Component> std::decay_t<Component>* entity::get() {
   using type = std::decay_t<Component>;
-  auto* const c = static_cast<type*>(_ecs->get_component_impl(_handle, _ecs->_components[type::id], type::id));
+  auto* const c = static_cast<type*>(_ecs->access_component_impl(_handle, type::id));
   return c;
 }
 template <traits::component_type Component> const std::decay_t<Component>* entity::get() const {
   using type = const std::decay_t<Component>;
-  auto* const c = static_cast<type*>(_ecs->get_component_impl(_handle, _ecs->_components[type::id], type::id));
+  auto* const c = static_cast<type*>(_ecs->get_component_impl(_handle, type::id));
   return c;
 }
+template <traits::component_type Component> bool entity::has() const {
+  return _ecs->has_component(_handle, std::decay_t<Component>::id);
+}
 
 template <traits::component_type... Components> entity ecs::create_entity(const Components&... components) {
   if constexpr (sizeof...(Components) == 0)
@@ -31,6 +48,17 @@ template <traits::component_type... Components> entity ecs::create_entity(const
   }
 }
 
+template <traits::component_type... Components>
+std::vector<entity> ecs::create_entities(size_t count, const Components&... prototypes) {
+  if constexpr (sizeof...(Components) == 0)
+    return create_entities(count, nullptr, nullptr, 0);
+  else {
+    const component_base* css[]{static_cast<const component_base*>(&prototypes)...};
+    id_t ids[]{prototypes.id...};
+    return create_entities(count, css, ids, sizeof...(Components));
+  }
+}
+
 template <traits::component_type... Components>
 unique_entity ecs::create_entity_unique(const Components&... components) {
   return unique_entity(new entity(create_entity(components...)));
@@ -54,4 +82,230 @@ bool ecs::remove_components(entity_handle handle) {
 template <traits::component_type Component> Component* ecs::get_component(entity_handle handle) {
   return static_cast<Component*>(get_component(handle, Component::id));
 }
+
+template <traits::component_type Component> bool ecs::has_component(entity_handle handle) const {
+  return has_component(handle, Component::id);
+}
+
+template <traits::component_type Component> void ecs::mark_changed(entity_handle handle) {
+  mark_changed(handle, Component::id);
+}
+
+template <traits::component_type Component> void ecs::reserve(size_t count) {
+  reserve(Component::id, count);
+}
+
+template <traits::component_type Component, typename Compare>
+bool ecs::sort_by(Compare&& compare, duration_type budget) {
+  using type = std::decay_t<Component>;
+  return sort_storage(storage(type::id), detail::sort_order<std::decay_t<Compare>>(),
+      [&](const component_base* a, const component_base* b) { return compare(a->as<type>(), b->as<type>()); },
+      deadline_of(budget));
+}
+
+template <typename Less>
+bool ecs::sort_storage(component_storage& store, uintptr_t order, Less&& less, clock::time_point deadline) {
+  if (store.sorted_count(order) == store.size())
+    return true;
+  if (deadline == clock::time_point::max()) {
+    std::vector<uint32_t> permutation(store.size());
+    std::iota(permutation.begin(), permutation.end(), 0u);
+    std::sort(permutation.begin(), permutation.end(),
+        [&](uint32_t a, uint32_t b) { return less(store.at(a), store.at(b)); });
+
+    // Element i receives the element currently at permutation[i], following each cycle with swaps.
+    for (auto i = 0u; i < permutation.size(); ++i) {
+      auto current = i;
+      while (permutation[current] != i) {
+        const auto next = permutation[current];
+        swap_components(store, current, next);
+        permutation[current] = current;
+        current = next;
+      }
+      permutation[current] = current;
+    }
+    store.set_sorted_count(order, store.size());
+    return true;
+  }
+
+  auto sorted = store.sorted_count(order);
+  for (size_t steps = 1; sorted < store.size(); ++steps) {
+    for (auto j = static_cast<uint32_t>(sorted); j > 0 && less(store.at(j), store.at(j - 1)); --j)
+      swap_components(store, j, j - 1);
+    ++sorted;
+    if (steps % 64 == 0 && clock::now() >= deadline)
+      break;
+  }
+  store.set_sorted_count(order, sorted);
+  return sorted == store.size();
+}
+template <traits::component_type Component, typename Fun> void ecs::propagate(Fun&& fun) {
+  using type = std::decay_t<Component>;
+  sort_hierarchy();
+  component_storage& nodes = storage(hierarchy::id);
+  component_storage& values = storage(type::id);
+  for (auto ni = 0u; ni < nodes.size(); ++ni) {
+    const auto& node = nodes.at(ni)->as<hierarchy>();
+    const auto element = values.index_of(index_of(node.entity));
+    if (element == component_storage::npos)
+      continue;
+    const component_base* parent = node.parent ? values.find(index_of(node.parent)) : nullptr;
+    fun(values.at(element)->as<type>(), parent ? parent->as_ptr<type>() : nullptr);
+    values.set_changed_tick(element, _tick);
+  }
+}
+
+template <traits::component_type Component, typename ExecutionPolicy, typename Fun>
+requires std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>>
+void ecs::propagate(ExecutionPolicy&& policy, Fun&& fun) {
+  using type = std::decay_t<Component>;
+  sort_hierarchy();
+  component_storage& nodes = storage(hierarchy::id);
+  component_storage& values = storage(type::id);
+  if (nodes.empty())
+    return;
+  // Children only read parents of the previous level and write distinct components and ticks, so a level can run in
+  // parallel. The shared sorted range of the storage is lowered up front instead of by every write.
+  values.limit_sorted_count(0);
+  auto* const first = nodes.at(0)->as_ptr<hierarchy>();
+  for (auto level = 0ull; level + 1 < _hierarchy_levels.size(); ++level) {
+    std::for_each(policy, first + _hierarchy_levels[level], first + _hierarchy_levels[level + 1],
+        [&](const hierarchy& node) {
+          const auto element = values.index_of(index_of(node.entity));
+          if (element == component_storage::npos)
+            return;
+          const component_base* parent = node.parent ? values.find(index_of(node.parent)) : nullptr;
+          fun(values.at(element)->as<type>(), parent ? parent->as_ptr<type>() : nullptr);
+          values.write_changed_tick(element, _tick);
+        });
+  }
+}
+template <typename T> T* system_base::resource() const {
+  return _world->resource<T>();
+}
+
+template <typename T> size_t ecs::resource_id() noexcept {
+  static const size_t id = next_resource_id();
+  return id;
+}
+
+template <typename T, typename... Args> T& ecs::emplace_resource(Args&&... args) {
+  const auto id = resource_id<T>();
+  if (_resources.size() <= id)
+    _resources.resize(id + 1);
+  auto resource = std::make_shared<T>(std::forward<Args>(args)...);
+  auto& result = *resource;
+  _resources[id] = std::move(resource);
+  return result;
+}
+
+template <typename T> T* ecs::resource() noexcept {
+  const auto id = resource_id<T>();
+  return id < _resources.size() ? static_cast<T*>(_resources[id].get()) : nullptr;
+}
+
+template <typename T> const T* ecs::resource() const noexcept {
+  const auto id = resource_id<T>();
+  return id < _resources.size() ? static_cast<const T*>(_resources[id].get()) : nullptr;
+}
+
+template <typename T> bool ecs::remove_resource() {
+  const auto id = resource_id<T>();
+  if (id >= _resources.size() || !_resources[id])
+    return false;
+  _resources[id].reset();
+  return true;
+}
+
+template <typename T> detail::shared_pool<T>& ecs::shared_pool() {
+  const auto id = static_cast<size_t>(shared<T>::id);
+  if (_shared_pools.size() <= id)
+    _shared_pools.resize(id + 1);
+  if (!_shared_pools[id])
+    _shared_pools[id] = std::make_unique<detail::shared_pool<T>>();
+  return static_cast<detail::shared_pool<T>&>(*_shared_pools[id]);
+}
+
+template <std::equality_comparable T> void ecs::set_shared(entity_handle handle, const T& value) {
+  auto& pool = shared_pool<T>();
+  const auto slot = pool.acquire(value);
+  if (auto* const reference = static_cast<shared<T>*>(access_component_impl(handle, shared<T>::id))) {
+    pool.release(reference->slot);
+    reference->slot = slot;
+    // The storage is no longer grouped by slot.
+    storage(shared<T>::id).set_sorted_count(0, 0);
+  } else {
+    shared<T> prototype;
+    prototype.slot = slot;
+    add_component_impl(handle, shared<T>::id, &prototype);
+  }
+}
+
+template <std::equality_comparable T> const T* ecs::get_shared(entity_handle handle) const {
+  const component_storage* store = find_storage(shared<T>::id);
+  const component_base* reference = store ? store->find(index_of(handle)) : nullptr;
+  if (!reference)
+    return nullptr;
+  const auto& pool = static_cast<const detail::shared_pool<T>&>(*_shared_pools[static_cast<size_t>(shared<T>::id)]);
+  return &*pool.values[reference->as<shared<T>>().slot];
+}
+
+template <std::equality_comparable T> bool ecs::remove_shared(entity_handle handle) {
+  return remove_component_impl(handle, shared<T>::id);
+}
+
+template <std::equality_comparable T, typename Fun> void ecs::for_each_shared(Fun&& fun) {
+  sort_by<shared<T>>([](const shared<T>& a, const shared<T>& b) { return a.slot < b.slot; });
+  const auto& pool = shared_pool<T>();
+  component_storage& store = storage(shared<T>::id);
+  if (store.empty())
+    return;
+  const auto* const references = store.at(0)->as_ptr<shared<T>>();
+  for (size_t begin = 0, end = 0; begin < store.size(); begin = end) {
+    while (end < store.size() && references[end].slot == references[begin].slot) ++end;
+    fun(*pool.values[references[begin].slot], std::span<const shared<T>>(references + begin, end - begin));
+  }
+}
+template <typename Event> event_stream<traits::event_type_t<Event>>& ecs::events() {
+  using stream_type = event_stream<traits::event_type_t<Event>>;
+  const auto id = resource_id<Event>();
+  if (_event_streams.size() <= id)
+    _event_streams.resize(id + 1);
+  if (!_event_streams[id]) {
+    auto stream = std::make_unique<stream_type>();
+    if constexpr (traits::component_event<Event>) {
+      using traits_type = traits::event_traits<Event>;
+      auto& streams = traits_type::on_add ? _added_events : _removed_events;
+      const auto component = static_cast<size_t>(traits_type::component::id);
+      if (streams.size() <= component)
+        streams.resize(component + 1, nullptr);
+      streams[component] = stream.get();
+    }
+    _event_streams[id] = std::move(stream);
+  }
+  return static_cast<stream_type&>(*_event_streams[id]);
+}
+template <traits::component_type T> component_reader<std::decay_t<T>> world_view::read() const {
+  using type = std::decay_t<T>;
+  const auto id = static_cast<size_t>(type::id);
+  if (id >= _world->_component_locks.size())
+    return {};
+  return component_reader<type>(_world->_components[id], _world->_component_locks[id]);
+}
+
+template <traits::component_type T> component_writer<std::decay_t<T>> world_view::write() const {
+  using type = std::decay_t<T>;
+  const auto id = static_cast<size_t>(type::id);
+  if (id >= _world->_component_locks.size())
+    return {};
+  return component_writer<type>(_world->_components[id], _world->_component_locks[id], _world->_tick);
+}
+
+template <traits::component_type T> bool world_view::has(entity_handle handle) const noexcept {
+  return ecs::as_entity(handle).test(std::decay_t<T>::id);
+}
+
+template <typename T> const T* world_view::resource() const noexcept {
+  return std::as_const(*_world).template resource<T>();
+}
 } // namespace myrt
\ No newline at end of file
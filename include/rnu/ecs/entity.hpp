@@ -1,11 +1,12 @@
 #pragma once
 
 #include "component.hpp"
+#include "signature.hpp"
 #include <memory>
 #include <vector>
 
 namespace rnu {
-using entity_info = std::vector<std::pair<id_t, uint32_t>>;
+using entity_info = component_signature;
 using indexed_entity = std::pair<uint32_t, entity_info>;
 
 namespace traits {
@@ -33,6 +34,7 @@ public:
   template <traits::component_type Component, traits::component_type... Components> bool remove();
   template <traits::component_type Component> std::decay_t<Component>* get();
   template <traits::component_type Component> const std::decay_t<Component>* get() const;
+  template <traits::component_type Component> bool has() const;
 
   operator entity_handle() const noexcept;
   operator bool() const noexcept;
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "entity.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace rnu {
+// Built-in event streams of ecs::events, e.g. ecs::events<added<transform>>(). Both carry the entity handle.
+// Handles in removed<T> may refer to entities which have been deleted since.
+template <traits::component_type T> struct added {};
+template <traits::component_type T> struct removed {};
+
+namespace traits {
+  template <typename Event> struct event_traits {
+    using type = Event;
+  };
+  template <typename T> struct event_traits<added<T>> {
+    using type = entity_handle;
+    using component = T;
+    static constexpr bool on_add = true;
+  };
+  template <typename T> struct event_traits<removed<T>> {
+    using type = entity_handle;
+    using component = T;
+    static constexpr bool on_add = false;
+  };
+  template <typename Event> using event_type_t = typename event_traits<Event>::type;
+
+  template <typename Event>
+  concept component_event = requires { typename event_traits<Event>::component; };
+} // namespace traits
+
+namespace detail {
+  struct event_stream_base {
+    virtual ~event_stream_base() = default;
+    virtual void update() = 0;
+  };
+} // namespace detail
+
+// Double buffered event queue. Events stay readable until the end of the ecs::update after the one they were sent
+// before, so every system gets to see them once. The buffers are reused, sending does not allocate once warmed up.
+template <typename Event> class event_stream : public detail::event_stream_base {
+public:
+  // Read position of one consumer, any number of readers can drain the same stream independently.
+  // A new reader starts at the oldest buffered event.
+  class reader {
+    friend class event_stream;
+    uint64_t _next = 0;
+  };
+
+  void send(const Event& event) {
+    _current.push_back(event);
+  }
+  void send(std::span<const Event> events) {
+    _current.insert(_current.end(), events.begin(), events.end());
+  }
+
+  // Calls "fun(std::span<const Event>)" with all events not yet seen by the reader, in at most two blocks.
+  // Returns the number of events read.
+  template <typename Fun> size_t read(reader& r, Fun&& fun) const {
+    size_t count = 0;
+    const auto visit = [&](const std::vector<Event>& events, uint64_t first) {
+      const auto begin = std::max(r._next, first) - first;
+      if (begin < events.size()) {
+        fun(std::span<const Event>(events).subspan(begin));
+        count += events.size() - begin;
+      }
+    };
+    visit(_previous, _previous_first);
+    visit(_current, _previous_first + _previous.size());
+    r._next = _previous_first + _previous.size() + _current.size();
+    return count;
+  }
+  // Number of events a reader has not seen yet.
+  size_t unread(const reader& r) const noexcept {
+    const auto end = _previous_first + _previous.size() + _current.size();
+    return end - std::clamp(r._next, _previous_first, end);
+  }
+
+  size_t size() const noexcept {
+    return _previous.size() + _current.size();
+  }
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  // Drops the oldest buffer, called by ecs::update after all systems ran.
+  void update() override {
+    _previous_first += _previous.size();
+    std::swap(_previous, _current);
+    _current.clear();
+  }
+
+private:
+  std::vector<Event> _previous;
+  std::vector<Event> _current;
+  uint64_t _previous_first = 0;
+};
+} // namespace rnu
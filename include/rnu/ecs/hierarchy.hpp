@@ -0,0 +1,24 @@
+#pragma once
+
+#include "component.hpp"
+#include <cstdint>
+
+namespace rnu {
+// Parent/child relation of an entity. Children of a parent form an intrusive, doubly linked sibling list.
+// Managed by ecs::set_parent, the links must not be modified directly.
+struct hierarchy : component<hierarchy> {
+  entity_handle parent = null_entity;
+  entity_handle first_child = null_entity;
+  entity_handle next_sibling = null_entity;
+  entity_handle prev_sibling = null_entity;
+  // Number of ancestors, roots have depth 0.
+  uint32_t depth = 0;
+};
+
+// The order the ecs keeps hierarchy components in, so every parent is stored before its children.
+struct hierarchy_depth_less {
+  bool operator()(const hierarchy& a, const hierarchy& b) const noexcept {
+    return a.depth < b.depth;
+  }
+};
+} // namespace rnu
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "entity.hpp"
+#include <span>
 
 namespace rnu {
 class listener {
@@ -17,16 +18,33 @@ public:
   virtual void on_add_component(entity e, id_t id) {}
   virtual void on_remove_component(entity e, id_t id) {}
 
+  // Called once per ecs::create_entities / ecs::delete_entities batch.
+  // The default implementations forward to the per-entity callbacks.
+  virtual void on_add_batch(std::span<const entity> entities) {
+    for (const auto& e : entities) on_add(e);
+  }
+  virtual void on_remove_batch(std::span<const entity> entities) {
+    for (const auto& e : entities) on_remove(e);
+  }
+  virtual void on_add_component_batch(std::span<const entity> entities, id_t id) {
+    for (const auto& e : entities) on_add_component(e, id);
+  }
+
   const std::vector<id_t>& component_ids() const noexcept {
     return _component_ids;
   }
+  const component_signature& signature() const noexcept {
+    return _signature;
+  }
 
 protected:
   void add_component_id(id_t id) {
     _component_ids.push_back(id);
+    _signature.set(id);
   }
 
 private:
   std::vector<id_t> _component_ids;
+  component_signature _signature;
 };
 } // namespace myrt
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string_view>
+
+namespace rnu {
+class system_base;
+
+// Collects per-system timings from ecs::update.
+// Recording only happens if rnu is compiled with RNU_ECS_PROFILING, otherwise ecs::update contains no profiling code.
+class ecs_profiler {
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct system_record {
+    const system_base* system;
+    std::string_view name;
+    uint64_t frame;
+    clock::time_point start;
+    clock::duration pre_update;
+    clock::duration update;
+    clock::duration post_update;
+    size_t entities;
+  };
+
+  struct frame_record {
+    uint64_t frame;
+    clock::time_point start;
+    clock::duration duration;
+  };
+
+  // Keeps the most recent "max_frames" frames.
+  explicit ecs_profiler(size_t max_frames = 300);
+
+  void begin_frame();
+  void end_frame();
+  void record(const system_record& record);
+  void clear();
+
+  const std::deque<system_record>& systems() const noexcept;
+  const std::deque<frame_record>& frames() const noexcept;
+
+  // Writes all records in the Chrome trace event format (chrome://tracing, Perfetto).
+  void write_chrome_trace(std::ostream& out) const;
+
+private:
+  size_t _max_frames;
+  uint64_t _frame = 0;
+  clock::time_point _epoch = clock::now();
+  clock::time_point _frame_start;
+  std::deque<system_record> _systems;
+  std::deque<frame_record> _frames;
+};
+} // namespace rnu
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "component.hpp"
+#include <concepts>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace rnu {
+// Component referencing a value of T that is stored once per ecs and shared by all entities with an equal value.
+// Added and changed through ecs::set_shared, iterated per value with ecs::for_each_shared.
+template <std::equality_comparable T> struct shared : component<shared<T>> {
+  uint32_t slot = 0;
+};
+
+namespace detail {
+  struct shared_pool_base {
+    virtual ~shared_pool_base() = default;
+    virtual void release(const component_base* reference) = 0;
+  };
+
+  // Interned values with a reference count each, slots of unreferenced values are reused.
+  // Values are found by linear search, which is fine for the few distinct values shared components usually have.
+  template <typename T> struct shared_pool : shared_pool_base {
+    uint32_t acquire(const T& value) {
+      for (auto i = 0u; i < values.size(); ++i) {
+        if (references[i] != 0 && *values[i] == value) {
+          ++references[i];
+          return i;
+        }
+      }
+      if (!free_slots.empty()) {
+        const auto slot = free_slots.back();
+        free_slots.pop_back();
+        values[slot].emplace(value);
+        references[slot] = 1;
+        return slot;
+      }
+      values.emplace_back(value);
+      references.push_back(1);
+      return static_cast<uint32_t>(values.size() - 1);
+    }
+
+    void release(uint32_t slot) {
+      if (--references[slot] == 0) {
+        values[slot].reset();
+        free_slots.push_back(slot);
+      }
+    }
+    void release(const component_base* reference) override {
+      release(reference->as<shared<T>>().slot);
+    }
+
+    std::vector<std::optional<T>> values;
+    std::vector<uint32_t> references;
+    std::vector<uint32_t> free_slots;
+  };
+} // namespace detail
+} // namespace rnu
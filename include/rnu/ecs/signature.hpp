@@ -0,0 +1,83 @@
+#pragma once
+
+#include "component.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace rnu {
+// Growable bitset with one bit per registered component type.
+class component_signature {
+public:
+  using word_type = uint64_t;
+  static constexpr size_t word_bits = sizeof(word_type) * 8;
+
+  component_signature() = default;
+
+  void set(id_t id) {
+    const auto [word, bit] = locate(id);
+    if (word >= _words.size())
+      _words.resize(word + 1, 0);
+    _words[word] |= bit;
+  }
+  void reset(id_t id) noexcept {
+    const auto [word, bit] = locate(id);
+    if (word < _words.size())
+      _words[word] &= ~bit;
+  }
+  bool test(id_t id) const noexcept {
+    const auto [word, bit] = locate(id);
+    return word < _words.size() && (_words[word] & bit) != 0;
+  }
+
+  // True if every bit set in "other" is also set in this signature.
+  bool contains(const component_signature& other) const noexcept {
+    for (auto i = 0ull; i < other._words.size(); ++i) {
+      const auto mine = i < _words.size() ? _words[i] : word_type(0);
+      if ((mine & other._words[i]) != other._words[i])
+        return false;
+    }
+    return true;
+  }
+  bool intersects(const component_signature& other) const noexcept {
+    const auto n = std::min(_words.size(), other._words.size());
+    for (auto i = 0ull; i < n; ++i)
+      if ((_words[i] & other._words[i]) != 0)
+        return true;
+    return false;
+  }
+
+  bool empty() const noexcept {
+    return std::all_of(_words.begin(), _words.end(), [](word_type w) { return w == 0; });
+  }
+  size_t count() const noexcept {
+    size_t n = 0;
+    for (const auto w : _words) n += std::popcount(w);
+    return n;
+  }
+  // Clears all bits but keeps the allocated words for reuse.
+  void clear() noexcept {
+    std::fill(_words.begin(), _words.end(), word_type(0));
+  }
+
+  template <typename Fun> void for_each(Fun&& fun) const {
+    for (auto i = 0ull; i < _words.size(); ++i) {
+      for (auto w = _words[i]; w != 0; w &= w - 1)
+        fun(id_t{i * word_bits + std::countr_zero(w)});
+    }
+  }
+
+  bool operator==(const component_signature& other) const noexcept {
+    return contains(other) && other.contains(*this);
+  }
+
+private:
+  static std::pair<size_t, word_type> locate(id_t id) noexcept {
+    const auto i = static_cast<size_t>(id);
+    return {i / word_bits, word_type(1) << (i % word_bits)};
+  }
+
+  std::vector<word_type> _words;
+};
+} // namespace rnu
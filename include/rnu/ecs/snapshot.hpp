@@ -0,0 +1,126 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace rnu {
+enum class snapshot_error {
+  file_not_found,
+  invalid_format,
+  type_mismatch,
+  not_serializable,
+};
+
+class snapshot_writer {
+public:
+  explicit snapshot_writer(std::vector<std::byte>& output) : _output(output) {}
+
+  void write(const void* data, size_t size) {
+    const auto offset = _output.size();
+    _output.resize(offset + size);
+    if (size != 0)
+      std::memcpy(_output.data() + offset, data, size);
+  }
+  template <typename T>
+  requires std::is_trivially_copyable_v<T>
+  void write(const T& value) {
+    write(&value, sizeof(T));
+  }
+  // Overwrites previously written bytes, e.g. to patch a size once it is known.
+  template <typename T>
+  requires std::is_trivially_copyable_v<T>
+  void write_at(size_t offset, const T& value) {
+    std::memcpy(_output.data() + offset, &value, sizeof(T));
+  }
+  void write(std::string_view str) {
+    write(static_cast<uint64_t>(str.size()));
+    write(str.data(), str.size());
+  }
+
+  // Pads the output with zeroes up to the next multiple of "alignment".
+  void align(size_t alignment) {
+    _output.resize((_output.size() + alignment - 1) / alignment * alignment);
+  }
+  size_t offset() const noexcept {
+    return _output.size();
+  }
+
+private:
+  std::vector<std::byte>& _output;
+};
+
+class snapshot_reader {
+public:
+  explicit snapshot_reader(std::span<const std::byte> input) : _input(input) {}
+
+  // Returns a view into the input without copying, or an empty span if not enough data is left.
+  std::span<const std::byte> read_bytes(size_t size) {
+    if (_failed || _input.size() - _offset < size) {
+      _failed = true;
+      return {};
+    }
+    const auto result = _input.subspan(_offset, size);
+    _offset += size;
+    return result;
+  }
+  bool read(void* data, size_t size) {
+    const auto bytes = read_bytes(size);
+    if (!bytes.empty())
+      std::memcpy(data, bytes.data(), size);
+    return !_failed;
+  }
+  template <typename T>
+  requires std::is_trivially_copyable_v<T>
+  T read() {
+    T value{};
+    read(&value, sizeof(T));
+    return value;
+  }
+  std::string_view read_string() {
+    const auto size = read<uint64_t>();
+    const auto bytes = read_bytes(size);
+    return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+  }
+
+  void align(size_t alignment) {
+    const auto aligned = (_offset + alignment - 1) / alignment * alignment;
+    if (aligned > _input.size())
+      _failed = true;
+    else
+      _offset = aligned;
+  }
+  size_t offset() const noexcept {
+    return _offset;
+  }
+  bool failed() const noexcept {
+    return _failed;
+  }
+
+private:
+  std::span<const std::byte> _input;
+  size_t _offset = 0;
+  bool _failed = false;
+};
+
+// Specialize for components which are not trivially copyable to make them part of ecs snapshots:
+//   template <> struct component_serializer<my_component> {
+//     static void save(const my_component& c, snapshot_writer& writer);
+//     static my_component load(snapshot_reader& reader);
+//   };
+// The specialization has to be visible wherever the component type is first used.
+template <typename T> struct component_serializer;
+
+namespace traits {
+  template <typename T>
+  concept has_component_serializer = requires(const T& c, snapshot_writer& w, snapshot_reader& r) {
+    component_serializer<T>::save(c, w);
+    { component_serializer<T>::load(r) } -> std::convertible_to<T>;
+  };
+} // namespace traits
+} // namespace rnu
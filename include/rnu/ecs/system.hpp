@@ -5,14 +5,46 @@
 #include "flags.hpp"
 #include <algorithm>
 #include <execution>
+#include <span>
+#include <string_view>
 
 namespace rnu {
 enum class component_flag : uint32_t {
   optional = 1 << 0,
+  // The system only reads the component, so updating it does not count as a change.
+  read_only = 1 << 1,
+  // Only entities whose component changed since the system last ran are updated.
+  changed = 1 << 2,
 };
 using component_flags = flags<component_flag>;
 
+// Query filter for typed_system, e.g. typed_system<changed<const transform>, mesh>.
+template <traits::component_type T> struct changed {};
+
+namespace traits {
+  template <typename T> struct query_traits {
+    using component = T;
+    static component_flags flags() {
+      return std::is_const_v<T> ? component_flags(component_flag::read_only) : component_flags{};
+    }
+  };
+
+  template <typename T> struct query_traits<changed<T>> {
+    using component = T;
+    static component_flags flags() {
+      return query_traits<T>::flags() | component_flag::changed;
+    }
+  };
+
+  template <typename T> using query_component_t = typename query_traits<T>::component;
+
+  template <typename T>
+  concept query_type = component_type<query_component_t<T>>;
+} // namespace traits
+
 class system_base {
+  friend class ecs;
+
 public:
   using duration_type = std::chrono::duration<double>;
 
@@ -25,10 +57,17 @@ public:
 
   virtual void pre_update() {}
   virtual void update(duration_type delta, component_base** components) const;
+  // Only called for chunked systems, with the first of "count" contiguous components of each type.
+  virtual void update_chunk(duration_type delta, size_t count, component_base** components) const;
   virtual void post_update() {}
+  // Used for profiling output, the returned string has to outlive the system.
+  virtual std::string_view name() const;
 
   const std::vector<id_t>& types() const;
   const std::vector<component_flags>& flags() const;
+  // All non-optional component types.
+  const component_signature& signature() const;
+  bool chunked() const noexcept;
 
 protected:
   template <traits::component_type T>
@@ -36,10 +75,20 @@ protected:
     add_component_type(T::id, flags);
   }
   void add_component_type(id_t id, component_flags flags = {});
+  void set_chunked(bool chunked) noexcept;
+
+  // The ecs running this system, only valid during pre_update, update and post_update.
+  ecs& world() const noexcept;
+  // Shorthand for world().resource<T>().
+  template <typename T> T* resource() const;
 
 private:
+  ecs* _world = nullptr;
   std::vector<id_t> _component_types;
   std::vector<component_flags> _component_flags;
+  component_signature _signature;
+  uint32_t _last_update_tick = 0;
+  bool _chunked = false;
 };
 
 using system = system_base;
@@ -103,22 +152,46 @@ private:
   rnu::system_list _list;
 };
 
-template <traits::component_type... Components> struct typed_system : public system {
+template <traits::query_type... Queries> struct typed_system : public system {
 public:
   typed_system() {
-    (add_component_type<Components>(), ...);
+    (add_component_type<traits::query_component_t<Queries>>(traits::query_traits<Queries>::flags()), ...);
   }
 
-  virtual void update(duration_type delta, Components*... components) const = 0;
+  virtual void update(duration_type delta, traits::query_component_t<Queries>*... components) const = 0;
 
   void update(duration_type delta, component_base** components) const final override {
-    update_impl(delta, components, std::make_index_sequence<sizeof...(Components)>{});
+    update_impl(delta, components, std::make_index_sequence<sizeof...(Queries)>{});
   }
 
 private:
   template <size_t... I>
   void update_impl(duration_type delta, component_base** components, std::index_sequence<I...>) const {
-    update(delta, components[I]->as_ptr<Components>()...);
+    update(delta, components[I]->as_ptr<traits::query_component_t<Queries>>()...);
+  }
+};
+
+// Receives contiguous spans of components instead of one entity at a time, e.g. to write vectorized loops.
+// All components are required here, entities lacking one or not matching a changed<T> filter split the chunks.
+// Chunks are longest when the component arrays share their entity order, e.g. after ecs::create_entities.
+template <traits::query_type... Queries> struct chunk_system : public system {
+public:
+  chunk_system() {
+    (add_component_type<traits::query_component_t<Queries>>(traits::query_traits<Queries>::flags()), ...);
+    set_chunked(true);
+  }
+
+  virtual void update(duration_type delta, std::span<traits::query_component_t<Queries>>... components) const = 0;
+
+  void update_chunk(duration_type delta, size_t count, component_base** components) const final override {
+    update_impl(delta, count, components, std::make_index_sequence<sizeof...(Queries)>{});
+  }
+
+private:
+  template <size_t... I>
+  void update_impl(duration_type delta, size_t count, component_base** components, std::index_sequence<I...>) const {
+    update(delta, std::span<traits::query_component_t<Queries>>(
+                      components[I]->as_ptr<traits::query_component_t<Queries>>(), count)...);
   }
 };
 
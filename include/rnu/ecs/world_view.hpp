@@ -0,0 +1,90 @@
+#pragma once
+
+#include "component_storage.hpp"
+#include "entity.hpp"
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+
+namespace rnu {
+class ecs;
+
+// Shared read access to all components of one type. Writers of the type block until the reader is destroyed.
+// A default constructed reader is empty, it is returned for types the view does not know.
+template <traits::component_type T> class component_reader {
+public:
+  component_reader() = default;
+  component_reader(const component_storage& store, std::shared_mutex& mutex) : _storage(&store), _lock(mutex) {}
+
+  const T* get(entity_handle handle) const noexcept {
+    const auto* c = _storage ? _storage->find(static_cast<const indexed_entity*>(handle)->first) : nullptr;
+    return c ? c->template as_ptr<T>() : nullptr;
+  }
+  bool contains(entity_handle handle) const noexcept {
+    return _storage && _storage->contains(static_cast<const indexed_entity*>(handle)->first);
+  }
+  // All components of the type, densely packed in storage order.
+  std::span<const T> components() const noexcept {
+    if (!_storage || _storage->empty())
+      return {};
+    return {_storage->at(0)->template as_ptr<T>(), _storage->size()};
+  }
+
+private:
+  const component_storage* _storage = nullptr;
+  std::shared_lock<std::shared_mutex> _lock;
+};
+
+// Exclusive access to all components of one type, blocks until all other readers and writers of the type are gone.
+// A default constructed writer is empty, it is returned for types the view does not know.
+template <traits::component_type T> class component_writer {
+public:
+  component_writer() = default;
+  component_writer(component_storage& store, std::shared_mutex& mutex, uint32_t tick)
+      : _storage(&store), _lock(mutex), _tick(tick) {}
+
+  // Stamps the component with the change tick, like entity::get.
+  T* get(entity_handle handle) noexcept {
+    if (!_storage)
+      return nullptr;
+    const auto element = _storage->index_of(static_cast<const indexed_entity*>(handle)->first);
+    if (element == component_storage::npos)
+      return nullptr;
+    _storage->set_changed_tick(element, _tick);
+    return _storage->at(element)->template as_ptr<T>();
+  }
+  const T* get(entity_handle handle) const noexcept {
+    const auto* c = _storage ? _storage->find(static_cast<const indexed_entity*>(handle)->first) : nullptr;
+    return c ? c->template as_ptr<T>() : nullptr;
+  }
+  bool contains(entity_handle handle) const noexcept {
+    return _storage && _storage->contains(static_cast<const indexed_entity*>(handle)->first);
+  }
+
+private:
+  component_storage* _storage = nullptr;
+  std::unique_lock<std::shared_mutex> _lock;
+  uint32_t _tick = 0;
+};
+
+// View of an ecs that can be shared by worker threads during parallel phases. Lookups never modify the ecs.
+// Components are accessed through readers and writers that lock their type, so a writer owns its type exclusively.
+// No entities or components may be created or deleted while a view is in use. Component types registered after the
+// view was created get empty readers and writers.
+class world_view {
+  friend class ecs;
+
+public:
+  template <traits::component_type T> component_reader<std::decay_t<T>> read() const;
+  template <traits::component_type T> component_writer<std::decay_t<T>> write() const;
+
+  template <traits::component_type T> bool has(entity_handle handle) const noexcept;
+  template <typename T> const T* resource() const noexcept;
+  size_t entity_count() const noexcept;
+
+private:
+  explicit world_view(ecs& world) : _world(&world) {}
+
+  ecs* _world;
+};
+} // namespace rnu
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace rnu
+{
+  // Read-only memory mapping of a whole file.
+  class mapped_file
+  {
+  public:
+    mapped_file() = default;
+    explicit mapped_file(std::filesystem::path const& path);
+    mapped_file(mapped_file const& other) = delete;
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file const& other) = delete;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+    ~mapped_file();
+
+    [[nodiscard]] bool is_open() const noexcept;
+    [[nodiscard]] explicit operator bool() const noexcept;
+
+    [[nodiscard]] std::span<std::byte const> bytes() const noexcept;
+    [[nodiscard]] std::span<char const> chars() const noexcept;
+    [[nodiscard]] std::size_t size() const noexcept;
+
+  private:
+    void close() noexcept;
+
+    void const* m_data = nullptr;
+    std::size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_descriptor = -1;
+#endif
+  };
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace rnu
+{
+  // Free list allocator for objects of type T, shared by all threads.
+  // Every thread caches a few free nodes, batches of nodes move between the caches and a shared list, so only every
+  // "batch_size"th allocation takes a lock and the global allocator is only used when the pool grows.
+  // Memory is never returned to the system, the pool keeps its peak size.
+  template<typename T>
+  class node_pool
+  {
+  public:
+    static constexpr size_t batch_size = 32;
+
+    [[nodiscard]] static void* allocate()
+    {
+      auto& cache = local_cache();
+      if (!cache.head)
+        refill(cache);
+      auto* const node = cache.head;
+      cache.head = node->next;
+      --cache.count;
+      return node;
+    }
+
+    static void deallocate(void* memory) noexcept
+    {
+      auto& cache = local_cache();
+      auto* const node = static_cast<free_node*>(memory);
+      node->next = cache.head;
+      cache.head = node;
+      if (++cache.count >= 2 * batch_size)
+        flush(cache, batch_size);
+    }
+
+    template<typename... Args>
+    [[nodiscard]] static T* create(Args&&... args)
+    {
+      void* const memory = allocate();
+      try
+      {
+        return new (memory) T(std::forward<Args>(args)...);
+      }
+      catch (...)
+      {
+        deallocate(memory);
+        throw;
+      }
+    }
+
+    static void destroy(T* object) noexcept
+    {
+      object->~T();
+      deallocate(object);
+    }
+
+  private:
+    struct free_node
+    {
+      free_node* next;
+    };
+
+    static constexpr size_t node_size = std::max(sizeof(T), sizeof(free_node));
+    static constexpr size_t node_alignment = std::max(alignof(T), alignof(free_node));
+    static constexpr size_t stride = (node_size + node_alignment - 1) / node_alignment * node_alignment;
+
+    struct shared_list
+    {
+      std::mutex mutex;
+      free_node* head = nullptr;
+    };
+
+    struct cache
+    {
+      free_node* head = nullptr;
+      size_t count = 0;
+
+      ~cache()
+      {
+        flush(*this, count);
+      }
+    };
+
+    static shared_list& shared()
+    {
+      // Never destroyed, so thread caches can flush into it during shutdown.
+      static auto* const list = new shared_list;
+      return *list;
+    }
+
+    static cache& local_cache()
+    {
+      thread_local cache c;
+      return c;
+    }
+
+    static void refill(cache& c)
+    {
+      {
+        auto& list = shared();
+        std::unique_lock<std::mutex> lock(list.mutex);
+        while (list.head && c.count < batch_size)
+        {
+          auto* const node = list.head;
+          list.head = node->next;
+          node->next = c.head;
+          c.head = node;
+          ++c.count;
+        }
+      }
+      if (c.head)
+        return;
+
+      auto* const block = static_cast<std::byte*>(::operator new(stride * batch_size, std::align_val_t{ node_alignment }));
+      for (size_t i = 0; i < batch_size; ++i)
+      {
+        auto* const node = new (block + i * stride) free_node{ c.head };
+        c.head = node;
+      }
+      c.count = batch_size;
+    }
+
+    static void flush(cache& c, size_t count) noexcept
+    {
+      auto& list = shared();
+      std::unique_lock<std::mutex> lock(list.mutex);
+      for (; count != 0 && c.head; --count)
+      {
+        auto* const node = c.head;
+        c.head = node->next;
+        node->next = list.head;
+        list.head = node;
+        --c.count;
+      }
+    }
+  };
+}
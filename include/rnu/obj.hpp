@@ -6,11 +6,16 @@
 #include <filesystem>
 #include <vector>
 #include <memory>
+#include <span>
 #include <rnu/math/math.hpp>
 #include <expected>
 
 namespace rnu
 {
+  template<typename ThreadData>
+  class basic_thread_pool;
+  using thread_pool = basic_thread_pool<void>;
+
   using obj_vec3 = vec3;
   using obj_vec2 = vec2;
   using obj_face = vec3ui32;
@@ -57,10 +62,18 @@ namespace rnu
   enum class loading_error
   {
     file_not_found,
-    invalid_normals_detected
+    invalid_normals_detected,
+    // The file exists but could not be opened or mapped, e.g. for missing permissions.
+    read_failed
   };
 
   std::expected<std::vector<object_t>, loading_error> load_obj(std::filesystem::path const& obj_file);
+  // Parses OBJ text that is already in memory, material libraries are loaded relative to "mtl_directory".
+  std::expected<std::vector<object_t>, loading_error> load_obj(std::span<char const> obj_data, std::filesystem::path const& mtl_directory);
+
+  // Parses the text in chunks of lines on "pool", with the same result as the overloads above.
+  std::expected<std::vector<object_t>, loading_error> load_obj(std::filesystem::path const& obj_file, thread_pool& pool);
+  std::expected<std::vector<object_t>, loading_error> load_obj(std::span<char const> obj_data, std::filesystem::path const& mtl_directory, thread_pool& pool);
 
   struct triangulated_object_t
   {
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <concepts>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <ranges>
+
+namespace rnu
+{
+  namespace detail
+  {
+    // Result of a range split off to another worker. Lives on the stack of the splitting job, which waits for it.
+    template<typename T>
+    struct split_result
+    {
+      std::optional<T> value;
+      std::exception_ptr exception;
+      std::atomic_bool done = false;
+    };
+
+    template<typename ThreadData>
+    void help_until(basic_thread_pool<ThreadData>& pool, std::atomic_bool const& done)
+    {
+      while (!done.load(std::memory_order_acquire))
+        if (!pool.try_run_one())
+          std::this_thread::yield();
+    }
+
+    template<typename ThreadData>
+    size_t default_grain(basic_thread_pool<ThreadData> const& pool, size_t count)
+    {
+      return std::max<size_t>(1, count / (8 * std::max(1u, pool.concurrency())));
+    }
+
+    // Runs [first, last) in blocks of "grain" and splits off the upper half of the remaining range to the pool.
+    // With "adaptive" set, ranges are only split while workers are idle, otherwise down to "grain".
+    // Split off ranges are always above the ones kept, so results are combined in order.
+    template<typename ThreadData, std::integral Index, typename T, typename Block, typename Reduce>
+    T reduce_range(basic_thread_pool<ThreadData>& pool, Index first, Index last, Index grain, bool adaptive,
+      T const& identity, Block const& block, Reduce const& reduce)
+    {
+      // Every split halves the remaining range, so there can not be more splits than bits in the index.
+      std::array<split_result<T>, sizeof(Index) * 8> splits;
+      size_t split_count = 0;
+
+      std::exception_ptr exception;
+      T result = identity;
+      try
+      {
+        while (first < last)
+        {
+          while (static_cast<size_t>(last - first) > static_cast<size_t>(grain) && (!adaptive || pool.idle_workers() != 0))
+          {
+            auto const middle = static_cast<Index>(first + (last - first) / 2);
+            auto& split = splits[split_count];
+            pool.run_detached([&pool, &split, &identity, &block, &reduce, middle, last, grain, adaptive](auto&&...) {
+              try
+              {
+                split.value.emplace(reduce_range(pool, middle, last, grain, adaptive, identity, block, reduce));
+              }
+              catch (...)
+              {
+                split.exception = std::current_exception();
+              }
+              split.done.store(true, std::memory_order_release);
+            });
+            // Only counted once submitted, a failed submission must not be waited for.
+            ++split_count;
+            last = middle;
+          }
+
+          auto const end = static_cast<Index>(first + std::min<size_t>(last - first, grain));
+          result = reduce(std::move(result), block(first, end));
+          first = end;
+        }
+      }
+      catch (...)
+      {
+        exception = std::current_exception();
+      }
+
+      // Splits reference this stack frame, so wait for all of them even when unwinding.
+      for (size_t i = split_count; i-- > 0;)
+      {
+        help_until(pool, splits[i].done);
+        if (!exception && splits[i].exception)
+          exception = splits[i].exception;
+        if (!exception)
+          result = reduce(std::move(result), std::move(*splits[i].value));
+      }
+      if (exception)
+        std::rethrow_exception(exception);
+      return result;
+    }
+
+    struct no_result
+    {
+    };
+
+    template<typename ThreadData, std::random_access_iterator It, typename Compare>
+    void sort_range(basic_thread_pool<ThreadData>& pool, It first, It last, size_t grain, Compare const& compare)
+    {
+      // Handed off partitions reference this stack frame. A deque keeps them in place while more are added.
+      std::deque<split_result<no_result>> splits;
+      std::exception_ptr exception;
+      try
+      {
+        while (static_cast<size_t>(last - first) > grain)
+        {
+          // Median of three as pivot, split into less, equal and greater so equal keys do not degrade the recursion.
+          auto const middle = first + (last - first) / 2;
+          auto const pivot = std::max(std::min(*first, *middle, compare), std::min(std::max(*first, *middle, compare), *(last - 1), compare), compare);
+          auto const equal_begin = std::partition(first, last, [&](auto const& v) { return compare(v, pivot); });
+          auto const equal_end = std::partition(equal_begin, last, [&](auto const& v) { return !compare(pivot, v); });
+
+          // Hand off the smaller part and continue with the larger one in this loop. Handed off parts are at most half
+          // of the range, so bad pivots make the loop longer but never nest deeper than log2 of the size.
+          auto smaller = std::pair(first, equal_begin);
+          auto larger = std::pair(equal_end, last);
+          if (smaller.second - smaller.first > larger.second - larger.first)
+            std::swap(smaller, larger);
+          first = larger.first;
+          last = larger.second;
+          if (static_cast<size_t>(smaller.second - smaller.first) <= grain)
+          {
+            std::sort(smaller.first, smaller.second, compare);
+            continue;
+          }
+
+          auto& split = splits.emplace_back();
+          try
+          {
+            pool.run_detached([&pool, &split, &compare, smaller, grain](auto&&...) {
+              try
+              {
+                sort_range(pool, smaller.first, smaller.second, grain, compare);
+              }
+              catch (...)
+              {
+                split.exception = std::current_exception();
+              }
+              split.done.store(true, std::memory_order_release);
+            });
+          }
+          catch (...)
+          {
+            splits.pop_back();
+            throw;
+          }
+        }
+        std::sort(first, last, compare);
+      }
+      catch (...)
+      {
+        exception = std::current_exception();
+      }
+
+      for (auto& split : splits)
+      {
+        help_until(pool, split.done);
+        if (!exception && split.exception)
+          exception = split.exception;
+      }
+      if (exception)
+        std::rethrow_exception(exception);
+    }
+  }
+
+  // Calls "fun(i)" for every i in [first, last).
+  // The range is split recursively down to "grain" indices per job. With a grain of 0 the grain is chosen from the
+  // range size and ranges are only split further while workers are idle.
+  // The calling thread takes part and runs other queued jobs while it waits, exceptions are rethrown on it.
+  template<typename ThreadData, std::integral Index, std::invocable<Index> Fun>
+  void parallel_for(basic_thread_pool<ThreadData>& pool, Index first, Index last, Fun&& fun, size_t grain = 0)
+  {
+    if (first >= last)
+      return;
+    auto const adaptive = grain == 0;
+    if (adaptive)
+      grain = detail::default_grain(pool, static_cast<size_t>(last - first));
+
+    detail::reduce_range(pool, first, last, static_cast<Index>(grain), adaptive, detail::no_result{},
+      [&](Index begin, Index end) {
+        for (auto i = begin; i < end; ++i)
+          fun(i);
+        return detail::no_result{};
+      },
+      [](detail::no_result, detail::no_result) { return detail::no_result{}; });
+  }
+
+  // Calls "fun(element)" for every element of a random access range.
+  template<typename ThreadData, std::ranges::random_access_range Range, typename Fun>
+    requires std::invocable<Fun&, std::ranges::range_reference_t<Range>>
+  void parallel_for(basic_thread_pool<ThreadData>& pool, Range&& range, Fun&& fun, size_t grain = 0)
+  {
+    auto const first = std::ranges::begin(range);
+    parallel_for(pool, size_t(0), static_cast<size_t>(std::ranges::size(range)),
+      [&](size_t i) { fun(first[i]); }, grain);
+  }
+
+  // Reduces "transform(i)" for every i in [first, last) with "reduce", which has to be associative.
+  // Partial results are combined in index order, splitting works like in parallel_for.
+  template<typename ThreadData, std::integral Index, typename T, std::invocable<Index> Transform, typename Reduce>
+    requires std::convertible_to<std::invoke_result_t<Reduce&, T, std::invoke_result_t<Transform&, Index>>, T>
+  T parallel_reduce(basic_thread_pool<ThreadData>& pool, Index first, Index last, T identity, Transform&& transform,
+    Reduce&& reduce, size_t grain = 0)
+  {
+    if (first >= last)
+      return identity;
+    auto const adaptive = grain == 0;
+    if (adaptive)
+      grain = detail::default_grain(pool, static_cast<size_t>(last - first));
+
+    return detail::reduce_range(pool, first, last, static_cast<Index>(grain), adaptive, identity,
+      [&](Index begin, Index end) {
+        T result = identity;
+        for (auto i = begin; i < end; ++i)
+          result = reduce(std::move(result), transform(i));
+        return result;
+      },
+      reduce);
+  }
+
+  // Parallel quicksort, partitions below "grain" elements are sorted with std::sort.
+  template<typename ThreadData, std::random_access_iterator It, typename Compare = std::less<>>
+  void parallel_sort(basic_thread_pool<ThreadData>& pool, It first, It last, Compare compare = {}, size_t grain = 0)
+  {
+    if (grain == 0)
+      grain = std::max<size_t>(2048, detail::default_grain(pool, static_cast<size_t>(last - first)));
+    detail::sort_range(pool, first, last, grain, compare);
+  }
+
+  template<typename ThreadData, std::ranges::random_access_range Range, typename Compare = std::less<>>
+  void parallel_sort(basic_thread_pool<ThreadData>& pool, Range&& range, Compare compare = {}, size_t grain = 0)
+  {
+    parallel_sort(pool, std::ranges::begin(range), std::ranges::end(range), std::move(compare), grain);
+  }
+}
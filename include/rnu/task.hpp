@@ -0,0 +1,311 @@
+#pragma once
+
+#include "task_graph.hpp"
+#include "thread_pool.hpp"
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+namespace rnu
+{
+  template<typename T = void>
+  class task;
+
+  namespace detail
+  {
+    class task_promise_base
+    {
+    public:
+      struct final_awaiter
+      {
+        bool await_ready() const noexcept
+        {
+          return false;
+        }
+
+        // Symmetric transfer to the awaiting coroutine, so long chains of tasks do not grow the stack.
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+          if (auto const continuation = handle.promise().m_continuation)
+            return continuation;
+          return std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+      };
+
+      std::suspend_always initial_suspend() const noexcept
+      {
+        return {};
+      }
+
+      final_awaiter final_suspend() const noexcept
+      {
+        return {};
+      }
+
+      void unhandled_exception() noexcept
+      {
+        m_exception = std::current_exception();
+      }
+
+      void set_continuation(std::coroutine_handle<> continuation) noexcept
+      {
+        m_continuation = continuation;
+      }
+
+    protected:
+      void rethrow_if_failed() const
+      {
+        if (m_exception)
+          std::rethrow_exception(m_exception);
+      }
+
+    private:
+      std::coroutine_handle<> m_continuation;
+      std::exception_ptr m_exception;
+    };
+
+    template<typename T>
+    class task_promise : public task_promise_base
+    {
+    public:
+      task<T> get_return_object() noexcept;
+
+      template<typename U = T>
+      void return_value(U&& value)
+      {
+        m_value.emplace(std::forward<U>(value));
+      }
+
+      T result()
+      {
+        rethrow_if_failed();
+        return std::move(*m_value);
+      }
+
+    private:
+      std::optional<T> m_value;
+    };
+
+    template<>
+    class task_promise<void> : public task_promise_base
+    {
+    public:
+      task<void> get_return_object() noexcept;
+
+      void return_void() const noexcept {}
+
+      void result() const
+      {
+        rethrow_if_failed();
+      }
+    };
+
+    // Starts right away and destroys itself when done, used to bridge tasks to job_futures.
+    struct detached_task
+    {
+      struct promise_type
+      {
+        detached_task get_return_object() const noexcept
+        {
+          return {};
+        }
+        std::suspend_never initial_suspend() const noexcept
+        {
+          return {};
+        }
+        std::suspend_never final_suspend() const noexcept
+        {
+          return {};
+        }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept
+        {
+          std::terminate();
+        }
+      };
+    };
+
+    template<typename T>
+    using non_void_t = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    template<typename T>
+    non_void_t<T> get_non_void(job_future<T>& future)
+    {
+      if constexpr (std::is_void_v<T>)
+      {
+        future.get();
+        return {};
+      }
+      else
+      {
+        return future.get();
+      }
+    }
+  }
+
+  // Lazily started coroutine. It runs when awaited, on the awaiting thread until it awaits something else,
+  // e.g. "co_await pool.schedule()" to move to a worker. Use start() to run a task from non-coroutine code.
+  template<typename T>
+  class [[nodiscard]] task
+  {
+  public:
+    using promise_type = detail::task_promise<T>;
+    using value_type = T;
+
+    task(task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    task& operator=(task&& other) noexcept
+    {
+      if (this != &other)
+      {
+        if (m_handle)
+          m_handle.destroy();
+        m_handle = std::exchange(other.m_handle, nullptr);
+      }
+      return *this;
+    }
+    task(task const&) = delete;
+    task& operator=(task const&) = delete;
+    ~task()
+    {
+      if (m_handle)
+        m_handle.destroy();
+    }
+
+    auto operator co_await() && noexcept
+    {
+      struct awaiter
+      {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() const noexcept
+        {
+          return false;
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+          handle.promise().set_continuation(awaiting);
+          return handle;
+        }
+
+        T await_resume()
+        {
+          return handle.promise().result();
+        }
+      };
+      return awaiter{ m_handle };
+    }
+
+  private:
+    friend promise_type;
+
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept : m_handle(handle) {}
+
+    std::coroutine_handle<promise_type> m_handle;
+  };
+
+  template<typename T>
+  task<T> detail::task_promise<T>::get_return_object() noexcept
+  {
+    return task<T>(std::coroutine_handle<task_promise>::from_promise(*this));
+  }
+
+  inline task<void> detail::task_promise<void>::get_return_object() noexcept
+  {
+    return task<void>(std::coroutine_handle<task_promise>::from_promise(*this));
+  }
+
+  // Awaiting a job_future suspends until the job is ready and resumes on the thread that completed it.
+  template<typename R>
+  auto operator co_await(job_future<R>&& future) noexcept
+  {
+    struct awaiter
+    {
+      job_future<R> future;
+
+      bool await_ready() const noexcept
+      {
+        return future.is_ready();
+      }
+
+      // Resumes right away instead of inside of await_suspend if the job completed after await_ready.
+      bool await_suspend(std::coroutine_handle<> handle)
+      {
+        return future.try_on_ready([handle] { handle.resume(); });
+      }
+
+      R await_resume()
+      {
+        return future.get();
+      }
+    };
+    return awaiter{ std::move(future) };
+  }
+
+  namespace detail
+  {
+    template<typename T>
+    detached_task run_task(task<T> t, job_state<T>* state)
+    {
+      try
+      {
+        if constexpr (std::is_void_v<T>)
+        {
+          co_await std::move(t);
+          state->set_value();
+        }
+        else
+        {
+          state->set_value(co_await std::move(t));
+        }
+      }
+      catch (...)
+      {
+        state->set_exception(std::current_exception());
+      }
+      state->release();
+    }
+  }
+
+  // Runs the task on the calling thread until its first suspension and returns a future for its result.
+  template<typename T>
+  [[nodiscard]] job_future<T> start(task<T> t)
+  {
+    auto* const state = node_pool<detail::job_state<T>>::create();
+    state->add_reference();
+    detail::run_task(std::move(t), state);
+    return job_future<T>(state);
+  }
+
+  // Starts all tasks and completes once every one of them did, tasks run concurrently from their first suspension
+  // on, e.g. after "co_await pool.schedule()". Results of void tasks are std::monostate.
+  // If tasks failed, the exception of the first one in argument order is rethrown after all have finished.
+  template<typename... T>
+  task<std::tuple<detail::non_void_t<T>...>> when_all(task<T>... tasks)
+  {
+    auto ready = co_await when_all(start(std::move(tasks))...);
+    co_return std::apply([](auto&... futures) { return std::tuple<detail::non_void_t<T>...>(detail::get_non_void(futures)...); }, ready);
+  }
+
+  template<typename T>
+  task<std::vector<detail::non_void_t<T>>> when_all(std::vector<task<T>> tasks)
+  {
+    std::vector<job_future<T>> futures;
+    futures.reserve(tasks.size());
+    for (auto& t : tasks)
+      futures.push_back(start(std::move(t)));
+    auto ready = co_await when_all(std::move(futures));
+
+    std::vector<detail::non_void_t<T>> results;
+    results.reserve(ready.size());
+    for (auto& future : ready)
+      results.push_back(detail::get_non_void(future));
+    co_return results;
+  }
+}
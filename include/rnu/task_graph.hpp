@@ -0,0 +1,346 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+namespace rnu
+{
+  template<typename Futures>
+  struct when_any_result
+  {
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    // Index of the first ready future, npos if there were none.
+    size_t index = npos;
+    Futures futures;
+  };
+
+  namespace detail
+  {
+    template<typename R>
+    void for_each_future(std::vector<job_future<R>>& futures, auto&& fun)
+    {
+      for (size_t i = 0; i < futures.size(); ++i)
+        fun(futures[i], i);
+    }
+
+    template<typename... R>
+    void for_each_future(std::tuple<job_future<R>...>& futures, auto&& fun)
+    {
+      [&]<size_t... I>(std::index_sequence<I...>) {
+        (fun(std::get<I>(futures), I), ...);
+      }(std::index_sequence_for<R...>{});
+    }
+
+    // Checked before anything is registered, an invalid future has no state to wait for.
+    template<typename Futures>
+    void require_valid(Futures& futures)
+    {
+      auto valid = true;
+      for_each_future(futures, [&](auto& future, size_t) { valid = valid && future.valid(); });
+      if (!valid)
+        throw std::invalid_argument("job_future without a state");
+    }
+
+    template<typename Futures>
+    job_future<Futures> when_all(Futures futures, size_t count)
+    {
+      require_valid(futures);
+      struct block
+      {
+        Futures futures;
+        // One per future and one for the registration, so the result is not set while futures are still registered.
+        std::atomic_size_t remaining;
+        job_state<Futures>* result;
+
+        void arrive()
+        {
+          if (remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+          result->set_value(std::move(futures));
+          result->release();
+          delete this;
+        }
+      };
+
+      auto* const result = node_pool<job_state<Futures>>::create();
+      result->add_reference();
+      auto* const b = new block{ std::move(futures), count + 1, result };
+      for_each_future(b->futures, [b](auto& future, size_t) { future.on_ready([b] { b->arrive(); }); });
+      b->arrive();
+      return job_future<Futures>(result);
+    }
+
+    template<typename Futures>
+    job_future<when_any_result<Futures>> when_any(Futures futures, size_t count)
+    {
+      require_valid(futures);
+      struct block
+      {
+        Futures futures;
+        std::atomic_size_t index = when_any_result<Futures>::npos;
+        // The first ready future and the registration, whichever comes last publishes the result.
+        std::atomic_uint publish = 2;
+        // One per future and one for the registration.
+        std::atomic_size_t references;
+        job_state<when_any_result<Futures>>* result;
+
+        void arrive(size_t i)
+        {
+          auto expected = when_any_result<Futures>::npos;
+          if (index.compare_exchange_strong(expected, i, std::memory_order_acq_rel))
+            try_publish();
+          release();
+        }
+
+        void try_publish()
+        {
+          if (publish.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+          result->set_value(when_any_result<Futures>{ index.load(std::memory_order_acquire), std::move(futures) });
+          result->release();
+        }
+
+        void release()
+        {
+          if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+        }
+      };
+
+      auto* const result = node_pool<job_state<when_any_result<Futures>>>::create();
+      result->add_reference();
+      auto* const b = new block{ .futures = std::move(futures), .references = count + 1, .result = result };
+      if (count == 0)
+        b->try_publish();
+      for_each_future(b->futures, [b](auto& future, size_t i) { future.on_ready([b, i] { b->arrive(i); }); });
+      b->try_publish();
+      b->release();
+      return job_future<when_any_result<Futures>>(result);
+    }
+  }
+
+  // Ready once all futures are, without blocking a thread to wait for them. Yields the now ready futures.
+  // Throws std::invalid_argument if one of the futures is not valid().
+  template<typename R>
+  [[nodiscard]] job_future<std::vector<job_future<R>>> when_all(std::vector<job_future<R>> futures)
+  {
+    auto const count = futures.size();
+    return detail::when_all(std::move(futures), count);
+  }
+
+  template<typename... R>
+  [[nodiscard]] job_future<std::tuple<job_future<R>...>> when_all(job_future<R>... futures)
+  {
+    return detail::when_all(std::tuple<job_future<R>...>(std::move(futures)...), sizeof...(R));
+  }
+
+  // Ready once the first of the futures is. Yields its index and all futures, the others may still be pending.
+  // Throws std::invalid_argument if one of the futures is not valid().
+  template<typename R>
+  [[nodiscard]] job_future<when_any_result<std::vector<job_future<R>>>> when_any(std::vector<job_future<R>> futures)
+  {
+    auto const count = futures.size();
+    return detail::when_any(std::move(futures), count);
+  }
+
+  template<typename... R>
+  [[nodiscard]] job_future<when_any_result<std::tuple<job_future<R>...>>> when_any(job_future<R>... futures)
+  {
+    return detail::when_any(std::tuple<job_future<R>...>(std::move(futures)...), sizeof...(R));
+  }
+
+  // Tasks with explicit dependencies, run on a basic_thread_pool.
+  // Every task counts its unfinished dependencies. The task finishing the last dependency pushes the now ready task
+  // to the pool, or runs it right away if it is the first one it made ready, so no worker ever waits for another.
+  template<typename ThreadData = void>
+  class basic_task_graph
+  {
+  public:
+    using task = size_t;
+
+    basic_task_graph() = default;
+    basic_task_graph(basic_task_graph const&) = delete;
+    basic_task_graph& operator=(basic_task_graph const&) = delete;
+
+    template<job_function<ThreadData> Fun>
+    task emplace(Fun&& fun);
+
+    // "after" does not start before "before" has finished.
+    void precede(task before, task after);
+
+    [[nodiscard]] size_t size() const noexcept;
+
+    // Runs every task once. The graph must not be changed or run again until the returned future is ready.
+    // If a task throws, tasks that did not start yet are skipped and the future rethrows the first exception.
+    // Throws std::invalid_argument if the dependencies contain a cycle.
+    [[nodiscard]] job_future<void> run(basic_thread_pool<ThreadData>& pool);
+
+  private:
+    struct node
+    {
+      template<typename Fun>
+      explicit node(Fun&& f) : fun(std::forward<Fun>(f)) {}
+
+      unique_function<ref_fun_t<ThreadData, void>> fun;
+      std::vector<task> successors;
+      uint32_t dependencies = 0;
+      std::atomic_uint32_t remaining = 0;
+    };
+
+    void schedule(task t);
+    template<typename... Args>
+    void execute(task t, Args&... args);
+    void check_acyclic() const;
+
+    // Nodes hold atomics and are referenced by index, a deque keeps them in place.
+    std::deque<node> m_nodes;
+    basic_thread_pool<ThreadData>* m_pool = nullptr;
+    std::atomic_size_t m_unfinished = 0;
+    std::atomic_bool m_failed = false;
+    std::exception_ptr m_exception;
+    detail::job_state<void>* m_done = nullptr;
+  };
+
+  using task_graph = basic_task_graph<void>;
+
+  template<typename ThreadData>
+  template<job_function<ThreadData> Fun>
+  auto basic_task_graph<ThreadData>::emplace(Fun&& fun) -> task
+  {
+    m_nodes.emplace_back(std::forward<Fun>(fun));
+    return m_nodes.size() - 1;
+  }
+
+  template<typename ThreadData>
+  void basic_task_graph<ThreadData>::precede(task before, task after)
+  {
+    m_nodes[before].successors.push_back(after);
+    ++m_nodes[after].dependencies;
+  }
+
+  template<typename ThreadData>
+  size_t basic_task_graph<ThreadData>::size() const noexcept
+  {
+    return m_nodes.size();
+  }
+
+  template<typename ThreadData>
+  job_future<void> basic_task_graph<ThreadData>::run(basic_thread_pool<ThreadData>& pool)
+  {
+    check_acyclic();
+
+    m_pool = &pool;
+    m_failed.store(false, std::memory_order_relaxed);
+    m_exception = nullptr;
+    m_unfinished.store(m_nodes.size(), std::memory_order_relaxed);
+    for (auto& n : m_nodes)
+      n.remaining.store(n.dependencies, std::memory_order_relaxed);
+
+    m_done = node_pool<detail::job_state<void>>::create();
+    m_done->add_reference();
+    job_future<void> result(m_done);
+    if (m_nodes.empty())
+    {
+      std::exchange(m_done, nullptr)->set_value();
+      return result;
+    }
+
+    // Collect first, the roots may finish and change the counters while others are still being scheduled.
+    std::vector<task> roots;
+    for (task t = 0; t < m_nodes.size(); ++t)
+      if (m_nodes[t].dependencies == 0)
+        roots.push_back(t);
+    for (auto const t : roots)
+      schedule(t);
+    return result;
+  }
+
+  template<typename ThreadData>
+  void basic_task_graph<ThreadData>::schedule(task t)
+  {
+    m_pool->run_detached([this, t](auto&... args) { execute(t, args...); });
+  }
+
+  template<typename ThreadData>
+  template<typename... Args>
+  void basic_task_graph<ThreadData>::execute(task t, Args&... args)
+  {
+    for (;;)
+    {
+      auto& n = m_nodes[t];
+      if (!m_failed.load(std::memory_order_relaxed))
+      {
+        try
+        {
+          n.fun(args...);
+        }
+        catch (...)
+        {
+          if (!m_failed.exchange(true, std::memory_order_relaxed))
+            m_exception = std::current_exception();
+        }
+      }
+
+      std::optional<task> next;
+      for (auto const s : n.successors)
+      {
+        if (m_nodes[s].remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+          continue;
+        if (next)
+          schedule(s);
+        else
+          next = s;
+      }
+
+      if (m_unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+        // Last task, the graph may be destroyed as soon as the state is set.
+        auto* const done = std::exchange(m_done, nullptr);
+        if (auto exception = std::exchange(m_exception, nullptr))
+          done->set_exception(std::move(exception));
+        else
+          done->set_value();
+        done->release();
+        return;
+      }
+      if (!next)
+        return;
+      t = *next;
+    }
+  }
+
+  template<typename ThreadData>
+  void basic_task_graph<ThreadData>::check_acyclic() const
+  {
+    // Kahn's algorithm, every task is visited once all its dependencies were.
+    std::vector<uint32_t> remaining(m_nodes.size());
+    std::vector<task> ready;
+    for (task t = 0; t < m_nodes.size(); ++t)
+    {
+      remaining[t] = m_nodes[t].dependencies;
+      if (remaining[t] == 0)
+        ready.push_back(t);
+    }
+
+    size_t visited = 0;
+    while (!ready.empty())
+    {
+      auto const t = ready.back();
+      ready.pop_back();
+      ++visited;
+      for (auto const s : m_nodes[t].successors)
+        if (--remaining[s] == 0)
+          ready.push_back(s);
+    }
+    if (visited != m_nodes.size())
+      throw std::invalid_argument("task graph dependencies contain a cycle");
+  }
+}
@@ -6,8 +6,23 @@
 #include <functional>
 #include <mutex>
 #include <memory>
+#include <span>
+#include <array>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
 #include <deque>
+#include <optional>
+#include <variant>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
 #include <experimental/generator>
+#include "node_pool.hpp"
+#include "thread_pool_profiler.hpp"
+#include "unique_function.hpp"
+#include "work_stealing_deque.hpp"
 
 namespace rnu
 {
@@ -62,6 +77,529 @@ namespace rnu
   template<typename Arg, typename Result>
   using ref_fun_t = typename ref_fun<Arg, Result>::type;
 
+  // Jobs of a basic_thread_pool<ThreadData> are called with a ThreadData& unless ThreadData is void.
+  template<typename Fun, typename ThreadData>
+  concept job_function = (std::is_void_v<ThreadData> && std::invocable<Fun&>) ||
+    (!std::is_void_v<ThreadData> && std::invocable<Fun&, std::add_lvalue_reference_t<ThreadData>>);
+
+  template<typename Fun, typename ThreadData>
+  struct job_result
+  {
+    using type = std::invoke_result_t<Fun&, ThreadData&>;
+  };
+
+  template<typename Fun>
+  struct job_result<Fun, void>
+  {
+    using type = std::invoke_result_t<Fun&>;
+  };
+
+  template<typename Fun, typename ThreadData>
+  using job_result_t = typename job_result<std::decay_t<Fun>, ThreadData>::type;
+
+  template<typename ThreadData>
+  class basic_thread_pool;
+
+  // Thrown from job_future::get for jobs that were cancelled before they started.
+  class job_cancelled : public std::runtime_error
+  {
+  public:
+    job_cancelled() : std::runtime_error("job cancelled") {}
+  };
+
+  // Cooperative cancellation of queued jobs. A job is dropped without running if its token is stopped or its
+  // deadline passed before a worker starts it, jobs that already started are not interrupted.
+  // Share one std::stop_source between jobs to cancel them as a group.
+  struct job_cancellation
+  {
+    std::stop_token token;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+  };
+
+  namespace detail
+  {
+    // Result and continuations of a job, shared by the job and its job_future and allocated from a node_pool.
+    template<typename R>
+    class job_state
+    {
+    public:
+      using value_type = std::conditional_t<std::is_void_v<R>, std::monostate, R>;
+
+      enum status : uint32_t
+      {
+        pending,
+        has_value,
+        has_exception,
+        cancelled,
+      };
+
+      template<typename... Args>
+      void set_value(Args&&... args)
+      {
+        m_value.emplace(std::forward<Args>(args)...);
+        complete(has_value);
+      }
+
+      void set_exception(std::exception_ptr exception)
+      {
+        m_exception = std::move(exception);
+        complete(has_exception);
+      }
+
+      void set_cancelled()
+      {
+        complete(cancelled);
+      }
+
+      [[nodiscard]] bool is_ready() const noexcept
+      {
+        return m_status.load(std::memory_order_acquire) != pending;
+      }
+
+      [[nodiscard]] bool is_cancelled() const noexcept
+      {
+        return m_status.load(std::memory_order_acquire) == cancelled;
+      }
+
+      void wait() const noexcept
+      {
+        for (auto status = m_status.load(std::memory_order_acquire); status == pending; status = m_status.load(std::memory_order_acquire))
+          m_status.wait(status, std::memory_order_acquire);
+      }
+
+      // Moves the result out, call once after the state is ready.
+      R take()
+      {
+        auto const status = m_status.load(std::memory_order_acquire);
+        if (status == has_exception)
+          std::rethrow_exception(m_exception);
+        if (status == cancelled)
+          throw job_cancelled();
+        if constexpr (!std::is_void_v<R>)
+          return std::move(*m_value);
+      }
+
+      // Runs "continuation" on the completing thread once the state is ready, or right away if it already is.
+      // Continuations are pushed to a lock-free list and run in the order they were added.
+      void on_ready(unique_function<void()> continuation)
+      {
+        auto* const node = node_pool<continuation_node>::create(std::move(continuation));
+        if (!push(node))
+          run(node);
+      }
+
+      // Like on_ready, but drops "continuation" and returns false if the state is ready already.
+      bool try_on_ready(unique_function<void()> continuation)
+      {
+        auto* const node = node_pool<continuation_node>::create(std::move(continuation));
+        if (push(node))
+          return true;
+        node_pool<continuation_node>::destroy(node);
+        return false;
+      }
+
+      void add_reference() noexcept
+      {
+        m_references.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      void release() noexcept
+      {
+        if (m_references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+          node_pool<job_state>::destroy(this);
+      }
+
+    private:
+      struct continuation_node
+      {
+        explicit continuation_node(unique_function<void()>&& f) : fun(std::move(f)) {}
+
+        unique_function<void()> fun;
+        continuation_node* next = nullptr;
+      };
+
+      // Returns false without pushing "node" if the state is completed.
+      bool push(continuation_node* node)
+      {
+        auto* head = m_continuations.load(std::memory_order_acquire);
+        do
+        {
+          if (head == &s_completed)
+            return false;
+          node->next = head;
+        } while (!m_continuations.compare_exchange_weak(head, node, std::memory_order_acq_rel, std::memory_order_acquire));
+        return true;
+      }
+
+      static void run(continuation_node* node)
+      {
+        struct destroyer
+        {
+          continuation_node* node;
+          ~destroyer()
+          {
+            node_pool<continuation_node>::destroy(node);
+          }
+        } const destroy{ node };
+        node->fun();
+      }
+
+      void complete(status result)
+      {
+        m_status.store(result, std::memory_order_release);
+        m_status.notify_all();
+
+        // Reverse the pushed list to run continuations in order.
+        continuation_node* ordered = nullptr;
+        for (auto* node = m_continuations.exchange(&s_completed, std::memory_order_acq_rel); node;)
+        {
+          auto* const next = node->next;
+          node->next = ordered;
+          ordered = node;
+          node = next;
+        }
+        while (ordered)
+        {
+          auto* const next = ordered->next;
+          run(ordered);
+          ordered = next;
+        }
+      }
+
+      // Marks a completed state in m_continuations, no continuations can be added anymore.
+      inline static continuation_node s_completed{ nullptr };
+
+      std::atomic<uint32_t> m_status = pending;
+      std::atomic<uint32_t> m_references = 1;
+      std::atomic<continuation_node*> m_continuations = nullptr;
+      std::optional<value_type> m_value;
+      std::exception_ptr m_exception;
+    };
+
+    // Stores the result of "fun(args...)" in "state". Cancellation of a job the result depends on is forwarded.
+    template<typename Res, typename Fun, typename... Args>
+    void fulfill(job_state<Res>& state, Fun& fun, Args&&... args)
+    {
+      try
+      {
+        if constexpr (std::is_void_v<Res>)
+        {
+          fun(std::forward<Args>(args)...);
+          state.set_value();
+        }
+        else
+        {
+          state.set_value(fun(std::forward<Args>(args)...));
+        }
+      }
+      catch (job_cancelled const&)
+      {
+        state.set_cancelled();
+      }
+      catch (...)
+      {
+        state.set_exception(std::current_exception());
+      }
+    }
+
+    // Runs "fun" and stores its result in "state", fails the state with broken_promise if dropped without running.
+    template<typename Fun, typename Res>
+    struct promise_job
+    {
+      promise_job(job_state<Res>* s, Fun&& f) : state(s), fun(std::move(f)) {}
+      promise_job(job_state<Res>* s, Fun const& f) : state(s), fun(f) {}
+      promise_job(promise_job&& other) noexcept(std::is_nothrow_move_constructible_v<Fun>)
+        : state(std::exchange(other.state, nullptr)), fun(std::move(other.fun)) {}
+      ~promise_job()
+      {
+        if (state)
+        {
+          state->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+          state->release();
+        }
+      }
+
+      template<typename... Args>
+      void operator()(Args&&... args)
+      {
+        fulfill(*state, fun, std::forward<Args>(args)...);
+        std::exchange(state, nullptr)->release();
+      }
+
+      job_state<Res>* state;
+      Fun fun;
+    };
+
+    // Job that only runs if it was not cancelled before. "state" is optional, if set it reports the cancellation as
+    // soon as the token is stopped. The queued job itself stays in its queue and is dropped when a worker reaches it,
+    // the callable and its captures are destroyed right when the job is cancelled.
+    template<typename Fun, typename Res>
+    class cancellable_job
+    {
+    public:
+      cancellable_job(job_state<Res>* state, Fun&& fun, job_cancellation const& cancellation)
+        : m_control(node_pool<control>::create(state, std::move(fun), cancellation.deadline))
+      {
+        m_control->watch(cancellation.token);
+      }
+      cancellable_job(job_state<Res>* state, Fun const& fun, job_cancellation const& cancellation)
+        : m_control(node_pool<control>::create(state, fun, cancellation.deadline))
+      {
+        m_control->watch(cancellation.token);
+      }
+      cancellable_job(cancellable_job&& other) noexcept : m_control(std::exchange(other.m_control, nullptr)) {}
+      cancellable_job(cancellable_job const&) = delete;
+      ~cancellable_job()
+      {
+        if (m_control)
+          node_pool<control>::destroy(m_control);
+      }
+
+      template<typename... Args>
+      void operator()(Args&&... args)
+      {
+        if (!m_control->claim())
+          return;
+        if (std::chrono::steady_clock::now() > m_control->deadline)
+        {
+          m_control->cancel();
+          return;
+        }
+        if (m_control->state)
+          fulfill(*m_control->state, *m_control->fun, std::forward<Args>(args)...);
+        else
+          (*m_control->fun)(std::forward<Args>(args)...);
+      }
+
+    private:
+      struct control
+      {
+        struct canceller
+        {
+          control* self;
+          void operator()() const noexcept
+          {
+            if (self->claim())
+              self->cancel();
+          }
+        };
+
+        template<typename F>
+        control(job_state<Res>* s, F&& f, std::chrono::steady_clock::time_point d)
+          : state(s), fun(std::in_place, std::forward<F>(f)), deadline(d) {}
+        ~control()
+        {
+          // Waits for a concurrently running stop callback.
+          callback.reset();
+          // Dropped without running, e.g. by the pool destructor.
+          if (claim())
+            cancel();
+          if (state)
+            state->release();
+        }
+
+        void watch(std::stop_token const& token)
+        {
+          if (token.stop_possible())
+            callback.emplace(token, canceller{ this });
+        }
+
+        // Exactly one of running, cancelling and dropping the job wins.
+        bool claim() noexcept
+        {
+          return !claimed.exchange(true, std::memory_order_acq_rel);
+        }
+
+        // Only called by the winner of claim(), nothing else touches "fun" afterwards.
+        void cancel()
+        {
+          fun.reset();
+          if (state)
+            state->set_cancelled();
+        }
+
+        std::atomic_bool claimed = false;
+        job_state<Res>* state;
+        std::optional<Fun> fun;
+        std::chrono::steady_clock::time_point deadline;
+        std::optional<std::stop_callback<canceller>> callback;
+      };
+
+      control* m_control;
+    };
+
+    // Calls "fun" with the result of the ready "state", or rethrows its exception.
+    template<typename R, typename Fun>
+    struct continuation
+    {
+      continuation(job_state<R>* s, Fun&& f) : state(s), fun(std::move(f)) {}
+      continuation(job_state<R>* s, Fun const& f) : state(s), fun(f) {}
+      continuation(continuation&& other) noexcept(std::is_nothrow_move_constructible_v<Fun>)
+        : state(std::exchange(other.state, nullptr)), fun(std::move(other.fun)) {}
+      ~continuation()
+      {
+        if (state)
+          state->release();
+      }
+
+      template<typename... Args>
+      decltype(auto) operator()(Args&&...)
+      {
+        if constexpr (std::is_void_v<R>)
+        {
+          state->take();
+          return fun();
+        }
+        else
+        {
+          return fun(state->take());
+        }
+      }
+
+      job_state<R>* state;
+      Fun fun;
+    };
+
+    template<typename Fun, typename R>
+    struct continuation_result
+    {
+      using type = std::invoke_result_t<Fun&, R>;
+    };
+
+    template<typename Fun>
+    struct continuation_result<Fun, void>
+    {
+      using type = std::invoke_result_t<Fun&>;
+    };
+  }
+
+  template<typename Fun, typename R>
+  using continuation_result_t = typename detail::continuation_result<std::decay_t<Fun>, R>::type;
+
+  // Future of a job started with basic_thread_pool::submit. Move-only, like std::future.
+  template<typename R>
+  class job_future
+  {
+  public:
+    job_future() noexcept = default;
+    explicit job_future(detail::job_state<R>* state) noexcept : m_state(state) {}
+    job_future(job_future&& other) noexcept : m_state(std::exchange(other.m_state, nullptr)) {}
+    job_future& operator=(job_future&& other) noexcept
+    {
+      if (this != &other)
+      {
+        reset();
+        m_state = std::exchange(other.m_state, nullptr);
+      }
+      return *this;
+    }
+    job_future(job_future const&) = delete;
+    job_future& operator=(job_future const&) = delete;
+    ~job_future()
+    {
+      reset();
+    }
+
+    [[nodiscard]] bool valid() const noexcept
+    {
+      return m_state != nullptr;
+    }
+
+    [[nodiscard]] bool is_ready() const noexcept
+    {
+      return m_state->is_ready();
+    }
+
+    // Whether the job was cancelled before it started, get() throws job_cancelled then.
+    [[nodiscard]] bool is_cancelled() const noexcept
+    {
+      return m_state->is_cancelled();
+    }
+
+    void wait() const noexcept
+    {
+      m_state->wait();
+    }
+
+    // Waits for and returns the result or rethrows the exception of the job. The future is invalid afterwards.
+    R get()
+    {
+      m_state->wait();
+      auto* const state = std::exchange(m_state, nullptr);
+      struct releaser
+      {
+        detail::job_state<R>* state;
+        ~releaser()
+        {
+          state->release();
+        }
+      } const release{ state };
+      return state->take();
+    }
+
+    // Calls "fun" on the thread that completes the job, or right away if it is ready already.
+    // "fun" must not block, use then() to run longer work on a pool.
+    void on_ready(unique_function<void()> fun)
+    {
+      m_state->on_ready(std::move(fun));
+    }
+
+    // Registers "fun" like on_ready and returns true, or returns false without calling it if the job is ready.
+    bool try_on_ready(unique_function<void()> fun)
+    {
+      return m_state->try_on_ready(std::move(fun));
+    }
+
+    // Submits "fun(result)" (or "fun()" for void jobs) to "pool" once this job is ready, without blocking a worker
+    // to wait for it. If this job failed, "fun" is not called and the returned future rethrows its exception.
+    // The future is invalid afterwards, the pool must outlive the continuation.
+    template<typename ThreadData, typename Fun>
+      requires (std::is_void_v<R> ? std::invocable<Fun&> : std::invocable<Fun&, R>)
+    [[nodiscard]] job_future<continuation_result_t<Fun, R>> then(basic_thread_pool<ThreadData>& pool, Fun&& fun);
+
+  private:
+    void reset() noexcept
+    {
+      if (m_state)
+        std::exchange(m_state, nullptr)->release();
+    }
+
+    detail::job_state<R>* m_state = nullptr;
+  };
+
+  enum class thread_pool_mode
+  {
+    // All workers share one queue protected by a mutex.
+    shared_queue,
+    // Every worker owns a lock-free deque and steals from random other workers when it runs dry.
+    // Jobs submitted from a worker go to its own deque, other threads submit through a shared injection queue.
+    work_stealing,
+  };
+
+  // Queue lane of a job. High priority jobs run before any queued normal priority job, jobs already running are not
+  // interrupted.
+  enum class job_priority
+  {
+    normal,
+    high,
+  };
+
+  struct thread_pool_options
+  {
+    unsigned concurrency = std::thread::hardware_concurrency();
+    thread_pool_mode mode = thread_pool_mode::shared_queue;
+    // Workers are named "<name> <index>" for debuggers and profilers, cut to 15 characters on Linux.
+    std::string name;
+    // Worker i is pinned to the logical cpu cpus[i % cpus.size()]. Best effort, invalid cpus are ignored.
+    std::vector<unsigned> cpus;
+  };
+
+  namespace detail
+  {
+    // Applies the name and affinity options to the calling thread.
+    void configure_worker_thread(std::string_view name, unsigned index, std::optional<unsigned> cpu);
+  }
+
   template<typename ThreadData = void>
   class basic_thread_pool {
   public:
@@ -69,24 +607,208 @@ namespace rnu
     using job_async_t = std::function<ref_fun_t<ThreadData, Res>>;
     using job_fun_t = job_async_t<void>;
 
-    [[nodiscard]] basic_thread_pool(unsigned concurrency = std::thread::hardware_concurrency()) requires(std::is_void_v<ThreadData>);
-    [[nodiscard]] basic_thread_pool(std::function<ThreadData(unsigned id)> create_data = [] { return ThreadData{}; }, unsigned concurrency = std::thread::hardware_concurrency()) requires(!std::is_void_v<ThreadData>);
+    [[nodiscard]] basic_thread_pool(unsigned concurrency = std::thread::hardware_concurrency(), thread_pool_mode mode = thread_pool_mode::shared_queue) requires(std::is_void_v<ThreadData>);
+    [[nodiscard]] basic_thread_pool(std::function<ThreadData(unsigned id)> create_data = [] { return ThreadData{}; }, unsigned concurrency = std::thread::hardware_concurrency(), thread_pool_mode mode = thread_pool_mode::shared_queue) requires(!std::is_void_v<ThreadData>);
+    [[nodiscard]] explicit basic_thread_pool(thread_pool_options options) requires(std::is_void_v<ThreadData>);
+    [[nodiscard]] basic_thread_pool(std::function<ThreadData(unsigned id)> create_data, thread_pool_options options) requires(!std::is_void_v<ThreadData>);
     ~basic_thread_pool();
 
     template<typename Res = void>
     [[nodiscard]] auto run_async(job_async_t<Res> func);
 
-    void run_detached(job_fun_t job);
+    // Like run_async, but jobs and their result state come from per-thread node pools and callables of up to
+    // unique_function::inline_size bytes are stored in place, so submitting does not use the global allocator.
+    template<job_function<ThreadData> Fun>
+    [[nodiscard]] job_future<job_result_t<Fun, ThreadData>> submit(Fun&& fun, job_priority priority = job_priority::normal);
+    // The future reports cancellation as soon as the token is stopped, see job_cancellation.
+    template<job_function<ThreadData> Fun>
+    [[nodiscard]] job_future<job_result_t<Fun, ThreadData>> submit(Fun&& fun, job_cancellation const& cancellation,
+      job_priority priority = job_priority::normal);
+
+    template<job_function<ThreadData> Fun>
+    void run_detached(Fun&& job, job_priority priority = job_priority::normal);
+    template<job_function<ThreadData> Fun>
+    void run_detached(Fun&& job, job_cancellation const& cancellation, job_priority priority = job_priority::normal);
+
+    // Moves all jobs out of the span and queues them at once, taking the queue lock once and waking only as many
+    // workers as there are jobs that idle workers do not pick up already.
+    template<job_function<ThreadData> Fun>
+    void run_many(std::span<Fun> jobs, job_priority priority = job_priority::normal);
+
+    // Resumes the awaiting coroutine on a worker of the pool.
+    // If the pool is destroyed before a worker picked it up, the coroutine is resumed from the pool destructor and
+    // co_await throws job_cancelled, so the coroutine unwinds instead of staying suspended forever.
+    class schedule_awaiter
+    {
+    public:
+      schedule_awaiter(basic_thread_pool& pool, job_priority priority) noexcept : m_pool(&pool), m_priority(priority) {}
+
+      bool await_ready() const noexcept
+      {
+        return false;
+      }
+
+      void await_suspend(std::coroutine_handle<> handle)
+      {
+        m_pool->run_detached(resumer(handle, *this), m_priority);
+      }
+
+      void await_resume() const
+      {
+        if (m_dropped)
+          throw job_cancelled();
+      }
+
+    private:
+      // Resumes the coroutine exactly once, also when the job is destroyed without running.
+      class resumer
+      {
+      public:
+        resumer(std::coroutine_handle<> handle, schedule_awaiter& awaiter) noexcept : m_handle(handle), m_awaiter(&awaiter) {}
+        resumer(resumer&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)), m_awaiter(other.m_awaiter) {}
+        resumer& operator=(resumer&&) = delete;
+        ~resumer()
+        {
+          if (m_handle)
+          {
+            m_awaiter->m_dropped = true;
+            m_handle.resume();
+          }
+        }
+
+        void operator()(auto&...)
+        {
+          std::exchange(m_handle, nullptr).resume();
+        }
+
+      private:
+        std::coroutine_handle<> m_handle;
+        schedule_awaiter* m_awaiter;
+      };
+
+      basic_thread_pool* m_pool;
+      job_priority m_priority;
+      bool m_dropped = false;
+    };
+
+    // "co_await pool.schedule()" continues the calling coroutine on the pool.
+    [[nodiscard]] schedule_awaiter schedule(job_priority priority = job_priority::normal) noexcept;
 
     [[nodiscard]] unsigned concurrency() const;
+    [[nodiscard]] thread_pool_mode mode() const;
+    // Index of the calling worker thread of this pool, or -1 when called from any other thread.
+    [[nodiscard]] int current_worker() const;
+    // Number of workers currently waiting for jobs, spinning or asleep.
+    [[nodiscard]] unsigned idle_workers() const;
+
+    // Runs one queued job on the calling thread, so threads waiting for other jobs can help instead of blocking.
+    // Returns false if there was no job or the pool has ThreadData and the caller is not one of its workers.
+    bool try_run_one();
+
+#ifdef RNU_THREAD_POOL_PROFILING
+    // Records the jobs and idle times of all workers into the profiler, pass nullptr to stop recording.
+    // The profiler has to outlive the recording, workers without a slot in it are not recorded.
+    void set_profiler(thread_pool_profiler* profiler) noexcept;
+#endif
 
   private:
-    void thread_loop(std::stop_token stop_token, ThreadData* data);
+    struct job_node
+    {
+      template<typename Fun>
+      explicit job_node(Fun&& f) : fun(std::forward<Fun>(f)) {}
+
+      unique_function<ref_fun_t<ThreadData, void>> fun;
+      job_node* next = nullptr;
+#ifdef RNU_THREAD_POOL_PROFILING
+      thread_pool_profiler::clock::time_point enqueued = thread_pool_profiler::clock::now();
+#endif
+    };
+    using job_pool = node_pool<job_node>;
 
+    struct alignas(64) worker
+    {
+      work_stealing_deque<job_node*> jobs;
+      uint64_t random_state;
+    };
+
+    struct worker_context
+    {
+      basic_thread_pool const* pool = nullptr;
+      unsigned index = 0;
+      ThreadData* data = nullptr;
+#ifdef RNU_THREAD_POOL_PROFILING
+      // Whether the last job from take_job was stolen from another worker.
+      bool stolen = false;
+      // Run time of the jobs that ran through try_run_one inside of the current job.
+      thread_pool_profiler::clock::duration nested{};
+#endif
+    };
+
+    // Time since a worker ran out of jobs, only tracked when profiling.
+    struct idle_timer
+    {
+#ifdef RNU_THREAD_POOL_PROFILING
+      std::optional<thread_pool_profiler::clock::time_point> since;
+#endif
+    };
+
+    struct job_list
+    {
+      job_node* head = nullptr;
+      job_node* tail = nullptr;
+    };
+
+    template<typename Fun>
+    void enqueue(Fun&& fun, job_priority priority = job_priority::normal)
+    {
+      push_job(job_pool::create(std::forward<Fun>(fun)), priority);
+    }
+    void push_job(job_node* job, job_priority priority);
+    // Shared queue access, m_jobs_mutex has to be locked.
+    void push_back(job_node* job, job_priority priority);
+    // Appends the chain first..last of "count" linked jobs.
+    void splice(job_node* first, job_node* last, size_t count, job_priority priority);
+    // Takes high priority jobs first.
+    job_node* pop_front();
+    bool has_queued_jobs() const noexcept;
+    // Wakes sleeping workers for "count" new jobs, m_jobs_mutex has to be locked.
+    void wake(size_t count);
+    // Wakes one sleeping worker if jobs are left after a worker took one, m_jobs_mutex has to be locked.
+    void wake_for_remaining();
+    // Polls for queued jobs before a worker goes to sleep, returns true if there are some or the pool stops.
+    bool spin_for_jobs(std::stop_token const& stop_token);
+    void run_job(job_node* job, ThreadData* data);
+    void create_workers(unsigned concurrency);
+    void thread_loop(std::stop_token stop_token, ThreadData* data, unsigned index);
+    void stealing_thread_loop(std::stop_token stop_token, ThreadData* data, unsigned index);
+    // Pass -1 as index when not called from a worker.
+    job_node* take_job(int index);
+    void begin_idle(idle_timer& timer);
+    void end_idle(idle_timer& timer, unsigned index);
+
+    inline static thread_local worker_context t_current_worker;
+
+    thread_pool_mode m_mode;
     std::vector<std::jthread> m_threads;
-    std::deque<job_fun_t> m_jobs;
+    // Shared queue, or the injection queue for jobs submitted from outside of the pool in work stealing mode.
+    // Intrusive lists of job nodes indexed by job_priority, so queueing does not allocate.
+    // High priority jobs always go here, also when submitted from a worker in work stealing mode.
+    job_list m_jobs[2];
     std::mutex m_jobs_mutex;
     std::condition_variable m_wait_condition;
+    std::vector<std::unique_ptr<worker>> m_workers;
+    // The number of queued jobs in all queues.
+    std::atomic_size_t m_pending = 0;
+    std::atomic_size_t m_high_pending = 0;
+    std::atomic_uint m_sleeping = 0;
+    std::atomic_uint m_spinning = 0;
+#ifdef RNU_THREAD_POOL_PROFILING
+    std::atomic<thread_pool_profiler*> m_profiler = nullptr;
+#endif
+
+    // Polling rounds of an idle worker before it sleeps. Waking a sleeping thread takes much longer than a few
+    // yields, so this keeps the latency of bursty submissions low.
+    static constexpr unsigned spin_count = 64;
   };
 
   template<copyable_or_movable T>
@@ -99,76 +821,256 @@ namespace rnu
     using mutex_type = std::conditional_t<is_atomic<T>, empty_mutex, std::mutex>;
     using lock_type = std::conditional_t<is_atomic<T>, empty_lock, std::unique_lock<std::mutex>>;
 
-    [[nodiscard]] async_resource() = default;
-    [[nodiscard]] async_resource(T&& value) requires std::movable<T> : m_value(std::move(value)) {}
-    [[nodiscard]] async_resource(T const& value) requires std::copyable<T> : m_value(value) {}
+    [[nodiscard]] async_resource() = default;
+    [[nodiscard]] async_resource(T&& value) requires std::movable<T> : m_value(std::move(value)) {}
+    [[nodiscard]] async_resource(T const& value) requires std::copyable<T> : m_value(value) {}
+    template<typename Pt, async_loader<Pt, T> Func>
+    [[nodiscard]] async_resource(basic_thread_pool<Pt>& pool, Func&& loader) {
+      load_resource(pool, std::forward<Func>(loader));
+    }
+
+    [[nodiscard]] std::experimental::generator<iterable_type const*> iterate() const requires iterable<T> {
+      auto const lock = make_lock();
+      for (iterable_type const& item : m_value)
+        co_yield &item;
+    }
+
+    [[nodiscard]] std::experimental::generator<iterable_type*> iterate() requires iterable<T> {
+      auto const lock = make_lock();
+      for (iterable_type& item : m_value)
+        co_yield &item;
+    }
+
+    template<callable<T const&> ApplyFun>
+    void current(ApplyFun&& apply) const
+    {
+      auto const lock = make_lock();
+      apply(static_cast<T>(m_value));
+    }
+
+    [[nodiscard]] T&& extract_current() requires std::movable<T> {
+      auto const lock = make_lock();
+      return std::move(m_value);
+    }
+
+    template<typename Pt, async_loader<Pt, T> Func>
+    bool load_resource(basic_thread_pool<Pt>& pool, Func&& loader)
+    {
+      if (!is_ready()) return false;
+      m_current_process = pool.run_async([ld = std::forward<Func>(loader), this](auto&&... args){
+        auto value = ld(std::forward<decltype(args)>(args)...);
+        auto const lock = make_lock();
+        if constexpr (std::movable<T>)
+          m_value = std::move(value);
+        else if constexpr (std::copyable<T>)
+          m_value = value;
+        });
+      return true;
+    }
+
+    void wait() const {
+      m_current_process.wait();
+    }
+
+    bool is_ready()
+    {
+      return !m_current_process.valid() ||
+        m_current_process.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+  private:
+    lock_type make_lock() const {
+      if constexpr (is_atomic<T>)
+        return empty_lock{};
+      else
+        return std::unique_lock<std::mutex>(m_value_mutex);
+    }
+
+    value_type m_value;
+    mutable mutex_type m_value_mutex;
+    std::future<void> m_current_process;
+  };
+
+  // Variant of async_resource for values that are read far more often than they are loaded, e.g. by render threads.
+  // Every published value gets its own buffer and a reader pins the current one with a counter, so readers never
+  // lock and see a consistent snapshot for as long as they hold it. Publishing writes into a buffer no reader holds
+  // and swaps the current index, it only waits if readers pin all other buffers.
+  template<copyable_or_movable T, unsigned BufferCount = 3>
+    requires std::default_initializable<T>
+  class buffered_async_resource
+  {
+    static_assert(BufferCount >= 2, "buffered_async_resource needs at least two buffers");
+
+    struct alignas(64) buffer
+    {
+      std::atomic_uint32_t readers = 0;
+      T value{};
+    };
+
+  public:
+    using iterable_type = decltype(iterable_type_get<T>());
+
+    // Keeps a published value alive and unchanged until destroyed.
+    class snapshot
+    {
+    public:
+      snapshot(snapshot&& other) noexcept : m_buffer(std::exchange(other.m_buffer, nullptr)) {}
+      snapshot& operator=(snapshot&& other) noexcept
+      {
+        if (this != &other)
+        {
+          release();
+          m_buffer = std::exchange(other.m_buffer, nullptr);
+        }
+        return *this;
+      }
+      snapshot(snapshot const&) = delete;
+      snapshot& operator=(snapshot const&) = delete;
+      ~snapshot()
+      {
+        release();
+      }
+
+      [[nodiscard]] T const& get() const noexcept
+      {
+        return m_buffer->value;
+      }
+      [[nodiscard]] T const& operator*() const noexcept
+      {
+        return get();
+      }
+      [[nodiscard]] T const* operator->() const noexcept
+      {
+        return &get();
+      }
+
+    private:
+      friend buffered_async_resource;
+
+      explicit snapshot(buffer* b) noexcept : m_buffer(b) {}
+
+      void release() noexcept
+      {
+        if (m_buffer)
+          m_buffer->readers.fetch_sub(1, std::memory_order_release);
+      }
+
+      buffer* m_buffer;
+    };
+
+    [[nodiscard]] buffered_async_resource() = default;
+    [[nodiscard]] buffered_async_resource(T&& value) requires std::movable<T>
+    {
+      m_buffers[0].value = std::move(value);
+    }
+    [[nodiscard]] buffered_async_resource(T const& value) requires std::copyable<T>
+    {
+      m_buffers[0].value = value;
+    }
     template<typename Pt, async_loader<Pt, T> Func>
-    [[nodiscard]] async_resource(basic_thread_pool<Pt>& pool, Func&& loader) {
+    [[nodiscard]] buffered_async_resource(basic_thread_pool<Pt>& pool, Func&& loader)
+    {
       load_resource(pool, std::forward<Func>(loader));
     }
-
-    [[nodiscard]] std::experimental::generator<iterable_type const*> iterate() const requires iterable<T> {
-      auto const lock = make_lock();
-      for (iterable_type const& item : m_value)
-        co_yield &item;
+    buffered_async_resource(buffered_async_resource const&) = delete;
+    buffered_async_resource& operator=(buffered_async_resource const&) = delete;
+    ~buffered_async_resource()
+    {
+      wait();
     }
 
-    [[nodiscard]] std::experimental::generator<iterable_type*> iterate() requires iterable<T> {
-      auto const lock = make_lock();
-      for (iterable_type& item : m_value)
-        co_yield &item;
-    }
+    // Lock-free, the snapshot stays valid while newer values are published.
+    [[nodiscard]] snapshot current() const noexcept;
 
     template<callable<T const&> ApplyFun>
     void current(ApplyFun&& apply) const
     {
-      auto const lock = make_lock();
-      apply(static_cast<T>(m_value));
+      auto const value = current();
+      apply(*value);
     }
 
-    [[nodiscard]] T&& extract_current() requires std::movable<T> {
-      auto const lock = make_lock();
-      return std::move(m_value);
+    [[nodiscard]] std::experimental::generator<iterable_type const*> iterate() const requires iterable<T>
+    {
+      auto const value = current();
+      for (iterable_type const& item : *value)
+        co_yield &item;
     }
 
+    // Replaces the current value for all following readers. Concurrent publishers are serialized.
+    template<typename U = T>
+    void publish(U&& value);
+
+    // Returns false without loading if a previous load is still running.
     template<typename Pt, async_loader<Pt, T> Func>
     bool load_resource(basic_thread_pool<Pt>& pool, Func&& loader)
     {
       if (!is_ready()) return false;
-      m_current_process = pool.run_async([ld = std::forward<Func>(loader), this](auto&&... args){
-        auto value = ld(std::forward<decltype(args)>(args)...);
-        auto const lock = make_lock();
-        if constexpr (std::movable<T>)
-          m_value = std::move(value);
-        else if constexpr (std::copyable<T>)
-          m_value = value;
-        });
+      m_current_process = pool.run_async([ld = std::forward<Func>(loader), this](auto&&... args) {
+        publish(ld(std::forward<decltype(args)>(args)...));
+      });
       return true;
     }
 
-    void wait() const {
-      m_current_process.wait();
+    void wait() const
+    {
+      if (m_current_process.valid())
+        m_current_process.wait();
     }
 
-    bool is_ready()
+    bool is_ready() const
     {
       return !m_current_process.valid() ||
         m_current_process.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
     }
 
   private:
-    lock_type make_lock() const {
-      if constexpr (is_atomic<T>)
-        return empty_lock{};
-      else
-        return std::unique_lock<std::mutex>(m_value_mutex);
-    }
-
-    value_type m_value;
-    mutable mutex_type m_value_mutex;
+    mutable std::array<buffer, BufferCount> m_buffers;
+    std::atomic_uint32_t m_current = 0;
+    std::mutex m_publish_mutex;
     std::future<void> m_current_process;
   };
 
+  template<copyable_or_movable T, unsigned BufferCount>
+    requires std::default_initializable<T>
+  auto buffered_async_resource<T, BufferCount>::current() const noexcept -> snapshot
+  {
+    for (;;)
+    {
+      auto const index = m_current.load(std::memory_order_seq_cst);
+      auto& b = m_buffers[index];
+      b.readers.fetch_add(1, std::memory_order_seq_cst);
+      // The buffer may have been retired and reused by a publisher since the index was read, only keep it if it is
+      // still current. Publishers never write to the current buffer.
+      if (m_current.load(std::memory_order_seq_cst) == index)
+        return snapshot(&b);
+      b.readers.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  template<copyable_or_movable T, unsigned BufferCount>
+    requires std::default_initializable<T>
+  template<typename U>
+  void buffered_async_resource<T, BufferCount>::publish(U&& value)
+  {
+    std::unique_lock<std::mutex> lock(m_publish_mutex);
+    auto const current = m_current.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      for (unsigned i = 1; i < BufferCount; ++i)
+      {
+        auto const index = (current + i) % BufferCount;
+        auto& b = m_buffers[index];
+        // Readers check the index again after pinning a buffer, so one that is not current and unpinned is free.
+        if (b.readers.load(std::memory_order_seq_cst) != 0)
+          continue;
+        b.value = std::forward<U>(value);
+        m_current.store(index, std::memory_order_seq_cst);
+        return;
+      }
+      std::this_thread::yield();
+    }
+  }
+
   template<typename ThreadData>
   template<typename Res>
   auto basic_thread_pool<ThreadData>::run_async(job_async_t<Res> func)
@@ -177,8 +1079,7 @@ namespace rnu
     auto promise = std::make_shared<std::promise<result_type>>();
     std::future<result_type> future = promise->get_future();
 
-    std::unique_lock<std::mutex> lock(m_jobs_mutex);
-    m_jobs.push_back([p = std::move(promise), f = std::move(func)](auto&&... args) mutable{
+    enqueue([p = std::move(promise), f = std::move(func)](auto&&... args) mutable{
       try {
         if constexpr (std::same_as<result_type, void>)
         {
@@ -195,37 +1096,333 @@ namespace rnu
         p->set_exception(std::current_exception());
       }
     });
-    m_wait_condition.notify_one();
     return future;
   }
 
   template<typename ThreadData>
-  [[nodiscard]] basic_thread_pool<ThreadData>::basic_thread_pool(std::function<ThreadData(unsigned id)> create_data, unsigned concurrency) requires(!std::is_void_v<ThreadData>)
+  template<job_function<ThreadData> Fun>
+  auto basic_thread_pool<ThreadData>::submit(Fun&& fun, job_priority priority) -> job_future<job_result_t<Fun, ThreadData>>
+  {
+    using result_type = job_result_t<Fun, ThreadData>;
+    auto* const state = node_pool<detail::job_state<result_type>>::create();
+    // One reference for the job, one for the future.
+    state->add_reference();
+    enqueue(detail::promise_job<std::decay_t<Fun>, result_type>(state, std::forward<Fun>(fun)), priority);
+    return job_future<result_type>(state);
+  }
+
+  template<typename ThreadData>
+  template<job_function<ThreadData> Fun>
+  auto basic_thread_pool<ThreadData>::submit(Fun&& fun, job_cancellation const& cancellation, job_priority priority)
+    -> job_future<job_result_t<Fun, ThreadData>>
+  {
+    using result_type = job_result_t<Fun, ThreadData>;
+    auto* const state = node_pool<detail::job_state<result_type>>::create();
+    job_future<result_type> future(state);
+    if (cancellation.token.stop_requested())
+    {
+      state->set_cancelled();
+      return future;
+    }
+    state->add_reference();
+    enqueue(detail::cancellable_job<std::decay_t<Fun>, result_type>(state, std::forward<Fun>(fun), cancellation), priority);
+    return future;
+  }
+
+  template<typename R>
+  template<typename ThreadData, typename Fun>
+    requires (std::is_void_v<R> ? std::invocable<Fun&> : std::invocable<Fun&, R>)
+  auto job_future<R>::then(basic_thread_pool<ThreadData>& pool, Fun&& fun) -> job_future<continuation_result_t<Fun, R>>
+  {
+    using result_type = continuation_result_t<Fun, R>;
+    using continuation_type = detail::continuation<R, std::decay_t<Fun>>;
+
+    auto* const next = node_pool<detail::job_state<result_type>>::create();
+    next->add_reference();
+    auto* const state = std::exchange(m_state, nullptr);
+    // The continuation job takes over the reference of this future.
+    state->on_ready([&pool, job = detail::promise_job<continuation_type, result_type>(next, continuation_type(state, std::forward<Fun>(fun)))]() mutable {
+      pool.run_detached(std::move(job));
+    });
+    return job_future<result_type>(next);
+  }
+
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::push_job(job_node* job, job_priority priority)
+  {
+    if (m_mode == thread_pool_mode::work_stealing && priority == job_priority::normal && t_current_worker.pool == this)
+    {
+      m_workers[t_current_worker.index]->jobs.push(job);
+      // Pairs with the sleeping check of the workers, either they see the job or we see them sleeping.
+      m_pending.fetch_add(1);
+      if (m_sleeping.load() != 0)
+      {
+        std::unique_lock<std::mutex> lock(m_jobs_mutex);
+        wake(1);
+      }
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_jobs_mutex);
+    push_back(job, priority);
+    wake(1);
+  }
+
+  template<typename ThreadData>
+  template<job_function<ThreadData> Fun>
+  void basic_thread_pool<ThreadData>::run_many(std::span<Fun> jobs, job_priority priority)
+  {
+    if (jobs.empty())
+      return;
+
+    if (m_mode == thread_pool_mode::work_stealing && priority == job_priority::normal && t_current_worker.pool == this)
+    {
+      auto& local = m_workers[t_current_worker.index]->jobs;
+      for (auto& job : jobs)
+        local.push(job_pool::create(std::move(job)));
+      m_pending.fetch_add(jobs.size());
+      if (m_sleeping.load() != 0)
+      {
+        std::unique_lock<std::mutex> lock(m_jobs_mutex);
+        wake(jobs.size());
+      }
+      return;
+    }
+
+    // Build the chain outside of the lock.
+    job_node* first = nullptr;
+    job_node* last = nullptr;
+    try
+    {
+      for (auto& job : jobs)
+      {
+        auto* const node = job_pool::create(std::move(job));
+        if (last)
+          last->next = node;
+        else
+          first = node;
+        last = node;
+      }
+    }
+    catch (...)
+    {
+      while (first)
+        job_pool::destroy(std::exchange(first, first->next));
+      throw;
+    }
+
+    std::unique_lock<std::mutex> lock(m_jobs_mutex);
+    splice(first, last, jobs.size(), priority);
+    wake(jobs.size());
+  }
+
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::push_back(job_node* job, job_priority priority)
+  {
+    job->next = nullptr;
+    splice(job, job, 1, priority);
+  }
+
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::splice(job_node* first, job_node* last, size_t count, job_priority priority)
+  {
+    auto& list = m_jobs[static_cast<size_t>(priority)];
+    if (list.tail)
+      list.tail->next = first;
+    else
+      list.head = first;
+    list.tail = last;
+    if (priority == job_priority::high)
+      m_high_pending.fetch_add(count);
+    m_pending.fetch_add(count);
+  }
+
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::wake(size_t count)
+  {
+    // Spinning workers pick up jobs by themselves.
+    auto const spinning = m_spinning.load();
+    count = count > spinning ? count - spinning : 0;
+    auto const sleeping = m_sleeping.load();
+    if (count == 0 || sleeping == 0)
+      return;
+    if (count >= sleeping)
+    {
+      m_wait_condition.notify_all();
+      return;
+    }
+    while (count-- != 0)
+      m_wait_condition.notify_one();
+  }
+
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::wake_for_remaining()
+  {
+    // A spinning worker cancels the wake-ups of all pushes while it spins but takes only one job, so every worker
+    // that takes a job passes a wake-up on to the next one.
+    if (m_pending.load() != 0 && m_sleeping.load() != 0)
+      m_wait_condition.notify_one();
+  }
+
+  template<typename ThreadData>
+  bool basic_thread_pool<ThreadData>::spin_for_jobs(std::stop_token const& stop_token)
+  {
+    m_spinning.fetch_add(1);
+    auto found = false;
+    for (unsigned i = 0; i < spin_count && !found; ++i)
+    {
+      found = m_pending.load(std::memory_order_relaxed) != 0 || stop_token.stop_requested();
+      if (!found)
+        std::this_thread::yield();
+    }
+    m_spinning.fetch_sub(1);
+    return found;
+  }
+
+  template<typename ThreadData>
+  auto basic_thread_pool<ThreadData>::pop_front() -> job_node*
+  {
+    for (auto const priority : { job_priority::high, job_priority::normal })
+    {
+      auto& list = m_jobs[static_cast<size_t>(priority)];
+      if (auto* const job = list.head)
+      {
+        list.head = job->next;
+        if (!list.head)
+          list.tail = nullptr;
+        if (priority == job_priority::high)
+          m_high_pending.fetch_sub(1);
+        m_pending.fetch_sub(1);
+        return job;
+      }
+    }
+    return nullptr;
+  }
+
+  template<typename ThreadData>
+  bool basic_thread_pool<ThreadData>::has_queued_jobs() const noexcept
+  {
+    return m_jobs[0].head != nullptr || m_jobs[1].head != nullptr;
+  }
+
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::run_job(job_node* job, ThreadData* data)
   {
+#ifdef RNU_THREAD_POOL_PROFILING
+    // Taken before the job runs, also without a profiler, nested jobs set it again.
+    auto const stolen = std::exchange(t_current_worker.stolen, false);
+    auto* const profiler = t_current_worker.pool == this ? m_profiler.load(std::memory_order_acquire) : nullptr;
+    auto const enqueued = job->enqueued;
+    auto const queue_depth = m_pending.load(std::memory_order_relaxed);
+    auto const outer_nested = std::exchange(t_current_worker.nested, {});
+    auto const start = thread_pool_profiler::clock::now();
+#endif
+    if constexpr (std::is_void_v<ThreadData>)
+      job->fun();
+    else
+      job->fun(*data);
+    job_pool::destroy(job);
+#ifdef RNU_THREAD_POOL_PROFILING
+    auto const end = thread_pool_profiler::clock::now();
+    // The whole run time of this job is nested time of the job it ran in, if any.
+    auto const nested = std::exchange(t_current_worker.nested, outer_nested + (end - start));
+    if (profiler)
+      profiler->record_job(t_current_worker.index, enqueued, start, end, nested, stolen, queue_depth);
+#endif
+  }
+
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::begin_idle([[maybe_unused]] idle_timer& timer)
+  {
+#ifdef RNU_THREAD_POOL_PROFILING
+    if (!timer.since)
+      timer.since = thread_pool_profiler::clock::now();
+#endif
+  }
+
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::end_idle([[maybe_unused]] idle_timer& timer, [[maybe_unused]] unsigned index)
+  {
+#ifdef RNU_THREAD_POOL_PROFILING
+    if (!timer.since)
+      return;
+    if (auto* const profiler = m_profiler.load(std::memory_order_acquire))
+      profiler->record_idle(index, *timer.since, thread_pool_profiler::clock::now());
+    timer.since.reset();
+#endif
+  }
+
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::create_workers(unsigned concurrency)
+  {
+    if (m_mode != thread_pool_mode::work_stealing)
+      return;
     for (unsigned i = 0; i < concurrency; ++i)
     {
+      m_workers.push_back(std::make_unique<worker>());
+      m_workers.back()->random_state = 0x9e3779b97f4a7c15ull * (i + 1);
+    }
+  }
+
+  template<typename ThreadData>
+  [[nodiscard]] basic_thread_pool<ThreadData>::basic_thread_pool(std::function<ThreadData(unsigned id)> create_data, unsigned concurrency, thread_pool_mode mode) requires(!std::is_void_v<ThreadData>)
+    : basic_thread_pool(std::move(create_data), thread_pool_options{ .concurrency = concurrency, .mode = mode, .name = {}, .cpus = {} })
+  {
+  }
+
+  template<typename ThreadData>
+  basic_thread_pool<ThreadData>::basic_thread_pool(unsigned concurrency, thread_pool_mode mode) requires(std::is_void_v<ThreadData>)
+    : basic_thread_pool(thread_pool_options{ .concurrency = concurrency, .mode = mode, .name = {}, .cpus = {} })
+  {
+  }
+
+  template<typename ThreadData>
+  [[nodiscard]] basic_thread_pool<ThreadData>::basic_thread_pool(std::function<ThreadData(unsigned id)> create_data, thread_pool_options options) requires(!std::is_void_v<ThreadData>)
+    : m_mode(options.mode)
+  {
+    create_workers(options.concurrency);
+    for (unsigned i = 0; i < options.concurrency; ++i)
+    {
+      std::optional<unsigned> cpu;
+      if (!options.cpus.empty())
+        cpu = options.cpus[i % options.cpus.size()];
       auto promise = std::make_shared<std::promise<void>>();
       auto creation_future = promise->get_future(); 
-      m_threads.push_back(std::jthread([this, p = std::move(promise), i, &create_data](std::stop_token stop_token){
+      m_threads.push_back(std::jthread([this, p = std::move(promise), i, cpu, &create_data, &options](std::stop_token stop_token){
+          detail::configure_worker_thread(options.name, i, cpu);
           auto data = create_data(i);
           p->set_value();
-          thread_loop(stop_token, &data);
+          if (m_mode == thread_pool_mode::work_stealing)
+            stealing_thread_loop(stop_token, &data, i);
+          else
+            thread_loop(stop_token, &data, i);
         }));
 
       // ! Important ! 
-      // Ensures that "create_data" is still a valid reference in the thread function.
+      // Ensures that "create_data" and "options" are still valid references in the thread function.
       // Also ensures that there may not be any race conditions between the creation calls.
       creation_future.wait();
     }
   }
 
   template<typename ThreadData>
-  basic_thread_pool<ThreadData>::basic_thread_pool(unsigned concurrency) requires(std::is_void_v<ThreadData>)
+  basic_thread_pool<ThreadData>::basic_thread_pool(thread_pool_options options) requires(std::is_void_v<ThreadData>)
+    : m_mode(options.mode)
   {
-    for (unsigned i = 0; i < concurrency; ++i)
-      m_threads.push_back(std::jthread([this] (std::stop_token stop_token) {
-          thread_loop(stop_token, nullptr);
+    create_workers(options.concurrency);
+    for (unsigned i = 0; i < options.concurrency; ++i)
+    {
+      std::optional<unsigned> cpu;
+      if (!options.cpus.empty())
+        cpu = options.cpus[i % options.cpus.size()];
+      m_threads.push_back(std::jthread([this, i, name = options.name, cpu] (std::stop_token stop_token) {
+          detail::configure_worker_thread(name, i, cpu);
+          if (m_mode == thread_pool_mode::work_stealing)
+            stealing_thread_loop(stop_token, nullptr, i);
+          else
+            thread_loop(stop_token, nullptr, i);
         }));
+    }
   }
 
   template<typename ThreadData>
@@ -233,16 +1430,51 @@ namespace rnu
   {
     for (auto& thread : m_threads) thread.request_stop();
 
-    m_wait_condition.notify_all();
+    {
+      std::unique_lock<std::mutex> lock(m_jobs_mutex);
+      m_wait_condition.notify_all();
+    }
     for (auto& thread : m_threads) thread.join();
+
+    // Jobs that did not run anymore, the owners are gone so popping is safe. Destroying a job cancels its state,
+    // which can run then() continuations that queue new jobs, so drain until all queues stay empty.
+    for (auto drained = true; drained;)
+    {
+      drained = false;
+      while (auto* job = pop_front())
+      {
+        job_pool::destroy(job);
+        drained = true;
+      }
+      for (auto& w : m_workers)
+        while (auto* job = w->jobs.pop())
+        {
+          job_pool::destroy(job);
+          drained = true;
+        }
+    }
   }
 
   template<typename ThreadData>
-  void basic_thread_pool<ThreadData>::run_detached(job_fun_t job)
+  template<job_function<ThreadData> Fun>
+  void basic_thread_pool<ThreadData>::run_detached(Fun&& job, job_priority priority)
   {
-    std::unique_lock<std::mutex> lock(m_jobs_mutex);
-    m_jobs.push_back(std::move(job));
-    m_wait_condition.notify_one();
+    enqueue(std::forward<Fun>(job), priority);
+  }
+
+  template<typename ThreadData>
+  template<job_function<ThreadData> Fun>
+  void basic_thread_pool<ThreadData>::run_detached(Fun&& job, job_cancellation const& cancellation, job_priority priority)
+  {
+    if (cancellation.token.stop_requested())
+      return;
+    enqueue(detail::cancellable_job<std::decay_t<Fun>, void>(nullptr, std::forward<Fun>(job), cancellation), priority);
+  }
+
+  template<typename ThreadData>
+  auto basic_thread_pool<ThreadData>::schedule(job_priority priority) noexcept -> schedule_awaiter
+  {
+    return schedule_awaiter(*this, priority);
   }
 
   template<typename ThreadData>
@@ -252,27 +1484,183 @@ namespace rnu
   }
 
   template<typename ThreadData>
-  void basic_thread_pool<ThreadData>::thread_loop(std::stop_token stop_token, ThreadData* data)
+  thread_pool_mode basic_thread_pool<ThreadData>::mode() const
   {
+    return m_mode;
+  }
+
+  template<typename ThreadData>
+  int basic_thread_pool<ThreadData>::current_worker() const
+  {
+    return t_current_worker.pool == this ? static_cast<int>(t_current_worker.index) : -1;
+  }
+
+  template<typename ThreadData>
+  unsigned basic_thread_pool<ThreadData>::idle_workers() const
+  {
+    return m_sleeping.load(std::memory_order_relaxed) + m_spinning.load(std::memory_order_relaxed);
+  }
+
+#ifdef RNU_THREAD_POOL_PROFILING
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::set_profiler(thread_pool_profiler* profiler) noexcept
+  {
+    m_profiler.store(profiler, std::memory_order_release);
+  }
+#endif
+
+  template<typename ThreadData>
+  bool basic_thread_pool<ThreadData>::try_run_one()
+  {
+    auto const index = current_worker();
+    auto* const data = index >= 0 ? t_current_worker.data : nullptr;
+    if constexpr (!std::is_void_v<ThreadData>)
+      if (!data)
+        return false;
+
+    job_node* job = nullptr;
+    if (m_mode == thread_pool_mode::work_stealing)
+    {
+      job = take_job(index);
+    }
+    else
+    {
+      std::unique_lock<std::mutex> lock(m_jobs_mutex);
+      job = pop_front();
+    }
+    if (!job)
+      return false;
+
+    run_job(job, data);
+    return true;
+  }
+
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::thread_loop(std::stop_token stop_token, ThreadData* data, unsigned index)
+  {
+    t_current_worker = { this, index, data };
+    idle_timer idle;
     while (!stop_token.stop_requested()) {
+      begin_idle(idle);
+      spin_for_jobs(stop_token);
 
       std::unique_lock<std::mutex> lock(m_jobs_mutex);
-      m_wait_condition.wait(lock, [&] { return stop_token.stop_requested() || !m_jobs.empty(); });
+      m_sleeping.fetch_add(1);
+      m_wait_condition.wait(lock, [&] { return stop_token.stop_requested() || has_queued_jobs(); });
+      m_sleeping.fetch_sub(1);
 
       if (!stop_token.stop_requested())
       {
-        auto const fun = std::move(m_jobs.front());
-        m_jobs.pop_front();
+        auto* const job = pop_front();
+        wake_for_remaining();
         lock.unlock();
 
-        if constexpr (std::is_void_v<ThreadData>)
-          fun();
-        else
-          fun(*data);
+        end_idle(idle, index);
+
+        run_job(job, data);
 
         lock.lock();
       }
     }
+    t_current_worker = {};
+  }
+
+  template<typename ThreadData>
+  void basic_thread_pool<ThreadData>::stealing_thread_loop(std::stop_token stop_token, ThreadData* data, unsigned index)
+  {
+    t_current_worker = { this, index, data };
+    idle_timer idle;
+    while (!stop_token.stop_requested()) {
+      if (auto* const job = take_job(static_cast<int>(index)))
+      {
+        if (m_pending.load() != 0 && m_sleeping.load() != 0)
+        {
+          std::unique_lock<std::mutex> lock(m_jobs_mutex);
+          wake_for_remaining();
+        }
+        end_idle(idle, index);
+        run_job(job, data);
+        continue;
+      }
+      begin_idle(idle);
+      if (spin_for_jobs(stop_token))
+        continue;
+
+      std::unique_lock<std::mutex> lock(m_jobs_mutex);
+      m_sleeping.fetch_add(1);
+      m_wait_condition.wait(lock, [&] { return stop_token.stop_requested() || m_pending.load() != 0; });
+      m_sleeping.fetch_sub(1);
+    }
+    t_current_worker = {};
+  }
+
+  template<typename ThreadData>
+  auto basic_thread_pool<ThreadData>::take_job(int index) -> job_node*
+  {
+    if (m_high_pending.load(std::memory_order_relaxed) != 0)
+    {
+      std::unique_lock<std::mutex> lock(m_jobs_mutex);
+      if (auto* job = pop_front())
+        return job;
+    }
+    if (index >= 0)
+    {
+      if (auto* job = m_workers[index]->jobs.pop())
+      {
+        m_pending.fetch_sub(1);
+        return job;
+      }
+    }
+    if (m_pending.load(std::memory_order_relaxed) == 0)
+      return nullptr;
+
+    {
+      std::unique_lock<std::mutex> lock(m_jobs_mutex);
+      if (auto* job = pop_front())
+        return job;
+    }
+
+    thread_local uint64_t t_random_state = 0x9e3779b97f4a7c15ull ^ reinterpret_cast<uintptr_t>(&t_random_state);
+    auto& random_state = index >= 0 ? m_workers[index]->random_state : t_random_state;
+    auto const count = m_workers.size();
+#ifdef RNU_THREAD_POOL_PROFILING
+    auto* const profiler = index >= 0 ? m_profiler.load(std::memory_order_acquire) : nullptr;
+    uint64_t failed_steals = 0;
+    struct steal_recorder
+    {
+      thread_pool_profiler* profiler;
+      int index;
+      uint64_t const& failed;
+      ~steal_recorder()
+      {
+        if (profiler && failed != 0)
+          profiler->record_failed_steals(static_cast<unsigned>(index), failed);
+      }
+    } const record_steals{ profiler, index, failed_steals };
+#endif
+    for (size_t attempt = 0; attempt < count; ++attempt)
+    {
+      // xorshift64
+      random_state ^= random_state << 13;
+      random_state ^= random_state >> 7;
+      random_state ^= random_state << 17;
+      auto const victim = random_state % count;
+      if (static_cast<int>(victim) == index)
+        continue;
+      if (auto* job = m_workers[victim]->jobs.steal())
+      {
+        m_pending.fetch_sub(1);
+#ifdef RNU_THREAD_POOL_PROFILING
+        if (index >= 0)
+          t_current_worker.stolen = true;
+#endif
+        return job;
+      }
+#ifdef RNU_THREAD_POOL_PROFILING
+      ++failed_steals;
+#endif
+    }
+    return nullptr;
   }
 
   using thread_pool = basic_thread_pool<void>;
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace rnu
+{
+  // Histogram of durations in power of two buckets, bucket i counts durations below 2^i microseconds.
+  struct latency_histogram
+  {
+    using duration = std::chrono::nanoseconds;
+    static constexpr size_t bucket_count = 32;
+
+    void add(duration d) noexcept;
+    void merge(latency_histogram const& other) noexcept;
+    // Upper bound of the bucket containing the given quantile in [0, 1].
+    [[nodiscard]] duration quantile(double q) const noexcept;
+    [[nodiscard]] duration mean() const noexcept;
+
+    std::array<uint64_t, bucket_count> buckets{};
+    uint64_t count = 0;
+    duration total{};
+    duration max{};
+  };
+
+  struct thread_pool_worker_stats
+  {
+    uint64_t jobs_run = 0;
+    // Jobs taken from the deque of another worker in work stealing mode.
+    uint64_t jobs_stolen = 0;
+    uint64_t failed_steals = 0;
+    uint64_t max_queue_depth = 0;
+    std::chrono::nanoseconds busy{};
+    std::chrono::nanoseconds idle{};
+    // Time from submission to the start of a job.
+    latency_histogram queue_wait;
+    latency_histogram run_time;
+
+    void merge(thread_pool_worker_stats const& other) noexcept;
+  };
+
+  // Collects per-worker counters, latency histograms and a trace of jobs and idle times from a basic_thread_pool.
+  // Recording only happens if rnu is compiled with RNU_THREAD_POOL_PROFILING, otherwise the pool contains no
+  // profiling code. Every worker records into its own slot, stats() and write_chrome_trace() can be called any time.
+  class thread_pool_profiler
+  {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    // Keeps the most recent "max_trace_events" trace events per worker.
+    explicit thread_pool_profiler(unsigned worker_count, size_t max_trace_events = 100000);
+
+    // Records of workers beyond worker_count() are ignored. "nested" is the part of start..end spent running other
+    // jobs from within this one, it only counts as busy time of those.
+    void record_job(unsigned worker, clock::time_point enqueued, clock::time_point start, clock::time_point end,
+      clock::duration nested, bool stolen, size_t queue_depth);
+    void record_idle(unsigned worker, clock::time_point start, clock::time_point end);
+    void record_failed_steals(unsigned worker, uint64_t count);
+    void clear();
+
+    [[nodiscard]] unsigned worker_count() const noexcept;
+    [[nodiscard]] std::vector<thread_pool_worker_stats> stats() const;
+    // All workers merged.
+    [[nodiscard]] thread_pool_worker_stats total() const;
+
+    // Writes one track per worker with its jobs and idle times, and the queue depth as a counter, in the Chrome
+    // trace event format (chrome://tracing, Perfetto).
+    void write_chrome_trace(std::ostream& out) const;
+
+  private:
+    struct trace_event
+    {
+      clock::time_point start;
+      clock::time_point end;
+      clock::duration queue_wait;
+      size_t queue_depth;
+      bool idle;
+      bool stolen;
+    };
+
+    struct alignas(64) worker_slot
+    {
+      mutable std::mutex mutex;
+      thread_pool_worker_stats stats;
+      std::deque<trace_event> events;
+    };
+
+    void push_event(worker_slot& slot, trace_event const& event);
+
+    size_t m_max_trace_events;
+    clock::time_point m_epoch = clock::now();
+    std::unique_ptr<worker_slot[]> m_workers;
+    unsigned m_worker_count;
+  };
+}
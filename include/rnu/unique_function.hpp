@@ -0,0 +1,137 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace rnu
+{
+  template<typename Signature>
+  class unique_function;
+
+  // Move-only std::function replacement. Callables up to "inline_size" bytes are stored in place without allocating.
+  template<typename R, typename... Args>
+  class unique_function<R(Args...)>
+  {
+  public:
+    static constexpr size_t inline_size = 48;
+
+    unique_function() noexcept = default;
+    unique_function(std::nullptr_t) noexcept {}
+
+    template<typename Fun>
+      requires (!std::same_as<std::decay_t<Fun>, unique_function> && std::is_invocable_r_v<R, std::decay_t<Fun>&, Args...>)
+    unique_function(Fun&& fun)
+    {
+      using type = std::decay_t<Fun>;
+      if constexpr (stored_inline<type>)
+        new (m_storage) type(std::forward<Fun>(fun));
+      else
+        new (m_storage) type*(new type(std::forward<Fun>(fun)));
+      m_vtable = &vtable_for<type>;
+    }
+
+    unique_function(unique_function&& other) noexcept
+    {
+      move_from(other);
+    }
+
+    unique_function& operator=(unique_function&& other) noexcept
+    {
+      if (this != &other)
+      {
+        reset();
+        move_from(other);
+      }
+      return *this;
+    }
+
+    unique_function& operator=(std::nullptr_t) noexcept
+    {
+      reset();
+      return *this;
+    }
+
+    unique_function(unique_function const&) = delete;
+    unique_function& operator=(unique_function const&) = delete;
+
+    ~unique_function()
+    {
+      reset();
+    }
+
+    R operator()(Args... args)
+    {
+      return m_vtable->invoke(m_storage, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const noexcept
+    {
+      return m_vtable != nullptr;
+    }
+
+  private:
+    struct vtable
+    {
+      R(*invoke)(void* storage, Args&&... args);
+      void(*move)(void* dst, void* src) noexcept;
+      void(*destroy)(void* storage) noexcept;
+    };
+
+    template<typename Fun>
+    static constexpr bool stored_inline = sizeof(Fun) <= inline_size && alignof(Fun) <= alignof(std::max_align_t) &&
+      std::is_nothrow_move_constructible_v<Fun>;
+
+    template<typename Fun>
+    static Fun& target(void* storage) noexcept
+    {
+      if constexpr (stored_inline<Fun>)
+        return *std::launder(static_cast<Fun*>(storage));
+      else
+        return **std::launder(static_cast<Fun**>(storage));
+    }
+
+    template<typename Fun>
+    static constexpr vtable vtable_for{
+      [](void* storage, Args&&... args) -> R { return std::invoke(target<Fun>(storage), std::forward<Args>(args)...); },
+      [](void* dst, void* src) noexcept {
+        if constexpr (stored_inline<Fun>)
+        {
+          new (dst) Fun(std::move(target<Fun>(src)));
+          target<Fun>(src).~Fun();
+        }
+        else
+        {
+          new (dst) Fun*(*std::launder(static_cast<Fun**>(src)));
+        }
+      },
+      [](void* storage) noexcept {
+        if constexpr (stored_inline<Fun>)
+          target<Fun>(storage).~Fun();
+        else
+          delete &target<Fun>(storage);
+      },
+    };
+
+    void move_from(unique_function& other) noexcept
+    {
+      if (other.m_vtable)
+      {
+        other.m_vtable->move(m_storage, other.m_storage);
+        m_vtable = std::exchange(other.m_vtable, nullptr);
+      }
+    }
+
+    void reset() noexcept
+    {
+      if (m_vtable)
+        std::exchange(m_vtable, nullptr)->destroy(m_storage);
+    }
+
+    alignas(std::max_align_t) std::byte m_storage[inline_size];
+    vtable const* m_vtable = nullptr;
+  };
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace rnu
+{
+  // Chase-Lev work stealing deque (Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models").
+  // The owning thread pushes and pops at the bottom, any other thread may steal from the top.
+  // Holds pointers, an empty deque or a lost race returns nullptr.
+  template<typename T>
+  class work_stealing_deque
+  {
+    static_assert(std::is_pointer_v<T>);
+
+    struct ring
+    {
+      explicit ring(int64_t capacity)
+        : m_capacity(capacity), m_mask(capacity - 1), m_slots(std::make_unique<std::atomic<T>[]>(capacity))
+      {
+      }
+
+      T get(int64_t index) const noexcept
+      {
+        return m_slots[index & m_mask].load(std::memory_order_relaxed);
+      }
+
+      void put(int64_t index, T value) noexcept
+      {
+        m_slots[index & m_mask].store(value, std::memory_order_relaxed);
+      }
+
+      int64_t m_capacity;
+      int64_t m_mask;
+      std::unique_ptr<std::atomic<T>[]> m_slots;
+    };
+
+  public:
+    explicit work_stealing_deque(int64_t capacity = 256)
+    {
+      m_rings.push_back(std::make_unique<ring>(capacity));
+      m_ring.store(m_rings.back().get(), std::memory_order_relaxed);
+    }
+    work_stealing_deque(work_stealing_deque const&) = delete;
+    work_stealing_deque& operator=(work_stealing_deque const&) = delete;
+
+    // Owner only.
+    void push(T value)
+    {
+      auto const bottom = m_bottom.load(std::memory_order_relaxed);
+      auto const top = m_top.load(std::memory_order_acquire);
+      auto* current = m_ring.load(std::memory_order_relaxed);
+      if (bottom - top > current->m_capacity - 1)
+        current = grow(current, bottom, top);
+      current->put(bottom, value);
+      std::atomic_thread_fence(std::memory_order_release);
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only.
+    T pop()
+    {
+      auto const bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+      auto* const current = m_ring.load(std::memory_order_relaxed);
+      m_bottom.store(bottom, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      auto top = m_top.load(std::memory_order_relaxed);
+
+      T result = nullptr;
+      if (top <= bottom)
+      {
+        result = current->get(bottom);
+        if (top == bottom)
+        {
+          // Last element, race against thieves for it.
+          if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            result = nullptr;
+          m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+      }
+      else
+      {
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+      }
+      return result;
+    }
+
+    // Any thread.
+    T steal()
+    {
+      auto top = m_top.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      auto const bottom = m_bottom.load(std::memory_order_acquire);
+      if (top >= bottom)
+        return nullptr;
+
+      auto* const current = m_ring.load(std::memory_order_acquire);
+      T result = current->get(top);
+      if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+      return result;
+    }
+
+    // Approximation, only exact if no other thread is using the deque.
+    [[nodiscard]] bool empty() const noexcept
+    {
+      return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+    }
+
+  private:
+    ring* grow(ring* current, int64_t bottom, int64_t top)
+    {
+      auto next = std::make_unique<ring>(current->m_capacity * 2);
+      for (auto i = top; i < bottom; ++i)
+        next->put(i, current->get(i));
+      // Thieves may still read from the old ring, so it is kept alive until the deque is destroyed.
+      m_rings.push_back(std::move(next));
+      m_ring.store(m_rings.back().get(), std::memory_order_release);
+      return m_rings.back().get();
+    }
+
+    alignas(64) std::atomic<int64_t> m_top = 0;
+    alignas(64) std::atomic<int64_t> m_bottom = 0;
+    std::atomic<ring*> m_ring;
+    std::vector<std::unique_ptr<ring>> m_rings;
+  };
+}
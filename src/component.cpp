@@ -2,8 +2,8 @@
 
 namespace rnu
 {
-  auto component_base::types() -> std::vector<std::tuple<component_creator_fun, component_deleter_fun, size_t>>& {
-    static std::vector<std::tuple<component_creator_fun, component_deleter_fun, size_t>> t;
+  auto component_base::types() -> std::vector<component_type_info>& {
+    static std::vector<component_type_info> t;
     return t;
   }
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <rnu/ecs/ecs.hpp>
 #include <algorithm>
+#include <atomic>
 
 namespace rnu {
 entity::operator entity_handle() const noexcept {
@@ -17,14 +18,9 @@ void entity_deleter::operator()(entity* e) const {
 }
 
 ecs::~ecs() {
-  for (auto&& cp : _components) {
-    const size_t size = component_base::type_size(cp.first);
-    const auto deleter = component_base::get_deleter(cp.first);
-
-    for (auto i = 0ull; i < cp.second.size(); i += size) deleter(reinterpret_cast<component_base*>(&cp.second[i]));
-  }
-
+  _components.clear();
   for (auto&& e : _entities) delete e;
+  for (auto&& e : _free_entities) delete e;
 }
 
 void ecs::add_listener(listener& l) {
@@ -32,36 +28,21 @@ void ecs::add_listener(listener& l) {
 }
 
 entity ecs::create_entity(const component_base** components, const id_t* component_ids, size_t count) {
-  const auto e = new indexed_entity();
-  auto hnd = static_cast<entity_handle>(e);
-
-  for (auto i = 0u; i < count; ++i) {
-    if (!component_base::is_valid(component_ids[i])) {
-      delete e;
+  for (auto i = 0u; i < count; ++i)
+    if (!component_base::is_valid(component_ids[i]))
       return entity{this, null_entity};
-    }
-    add_component_impl(hnd, component_ids[i], components[i]);
-  }
 
+  const auto e = allocate_entity();
+  auto hnd = static_cast<entity_handle>(e);
   e->first = static_cast<uint32_t>(_entities.size());
   _entities.push_back(e);
 
+  for (auto i = 0u; i < count; ++i) add_component_impl(hnd, component_ids[i], components[i]);
+
   const entity result{this, hnd};
-  for (auto& l : _listeners) {
-    if (![&] {
-          for (const auto id : l->component_ids())
-            if (![&] {
-                  for (const auto& x : as_entity(hnd))
-                    if (id == x.first)
-                      return true;
-                  return false;
-                }())
-              return false;
-          return true;
-        }())
-      break;
-    l->on_add(result);
-  }
+  for (auto& l : _listeners)
+    if (listens_to(*l, e->second))
+      l->on_add(result);
 
   return result;
 }
@@ -69,28 +50,75 @@ entity ecs::create_entity(const component_base** components, const id_t* compone
 void ecs::delete_entity(entity handle) {
   auto& e = as_entity(handle._handle);
 
+  for (auto& l : _listeners)
+    if (listens_to(*l, e))
+      l->on_remove(handle);
+
+  const auto index = index_of(handle._handle);
+  e.for_each([&](id_t id) { delete_component(id, index); });
+  release_entity(index);
+}
+
+std::vector<entity> ecs::create_entities(
+    size_t count, const component_base** prototypes, const id_t* component_ids, size_t component_count) {
+  std::vector<entity> result;
+  for (auto i = 0u; i < component_count; ++i)
+    if (!component_base::is_valid(component_ids[i]))
+      return result;
+
+  component_signature signature;
+  for (auto i = 0u; i < component_count; ++i) signature.set(component_ids[i]);
+
+  result.reserve(count);
+  _entities.reserve(_entities.size() + count);
+  for (auto n = 0ull; n < count; ++n) {
+    const auto e = allocate_entity();
+    e->first = static_cast<uint32_t>(_entities.size());
+    e->second = signature;
+    _entities.push_back(e);
+    result.push_back(entity{this, static_cast<entity_handle>(e)});
+  }
+
+  // Construct one component type at a time so each array is grown once and written linearly.
+  for (auto i = 0u; i < component_count; ++i) {
+    auto& store = storage(component_ids[i]);
+    store.reserve(store.size() + count);
+    for (const auto& e : result) store.emplace(index_of(e._handle), e._handle, prototypes[i], _tick);
+    if (const auto events = component_events(_added_events, component_ids[i]))
+      for (const auto& e : result) events->send(e._handle);
+  }
+
+  if (result.empty())
+    return result;
+
   for (auto& l : _listeners) {
-    if (![&] {
-          for (const auto id : l->component_ids())
-            if (![&] {
-                  for (const auto& x : e)
-                    if (id == x.first)
-                      return true;
-                  return false;
-                }())
-              return false;
-          return true;
-        }())
-      break;
-    l->on_remove(handle);
+    for (auto i = 0u; i < component_count; ++i)
+      if (listens_to(*l, component_ids[i]))
+        l->on_add_component_batch(result, component_ids[i]);
+    // All entities of a batch share the same signature.
+    if (listens_to(*l, signature))
+      l->on_add_batch(result);
   }
+  return result;
+}
 
-  for (auto&& comp : e) delete_component(comp.first, comp.second);
-  const auto dst_idx = index_of(handle._handle);
-  delete _entities[dst_idx];
-  _entities[dst_idx] = _entities[_entities.size() - 1];
-  _entities[dst_idx]->first = dst_idx;
-  _entities.pop_back();
+void ecs::delete_entities(std::span<const entity> handles) {
+  std::vector<entity> matching;
+  matching.reserve(handles.size());
+  for (auto& l : _listeners) {
+    matching.clear();
+    for (const auto& e : handles)
+      if (listens_to(*l, as_entity(e._handle)))
+        matching.push_back(e);
+    if (!matching.empty())
+      l->on_remove_batch(matching);
+  }
+
+  for (const auto& e : handles) {
+    const auto index = index_of(e._handle);
+    as_entity(e._handle).for_each([&](id_t id) { delete_component(id, index); });
+    release_entity(index);
+  }
 }
 
 unique_entity ecs::create_entity_unique(const component_base** components, const id_t* component_ids, size_t count) {
@@ -102,150 +130,373 @@ shared_entity ecs::create_entity_shared(const component_base** components, const
 }
 
 component_base* ecs::get_component(entity_handle handle, id_t cid) {
-  return get_component_impl(handle, _components.at(cid), cid);
+  return access_component_impl(handle, cid);
+}
+
+bool ecs::has_component(entity_handle handle, id_t cid) const {
+  return as_entity(handle).test(cid);
+}
+
+void ecs::reserve(id_t cid, size_t count) {
+  storage(cid).reserve(count);
+}
+
+bool ecs::compact(duration_type budget) {
+  const auto deadline = deadline_of(budget);
+  // Any constant distinct from the addresses used by sort_by.
+  constexpr uintptr_t entity_order = 1;
+  const auto by_entity = [&](const component_base* a, const component_base* b) {
+    return index_of(a->entity) < index_of(b->entity);
+  };
+
+  for (auto visited = 0ull; visited < _components.size(); ++visited) {
+    if (_compact_cursor >= _components.size())
+      _compact_cursor = 0;
+    if (!sort_storage(_components[_compact_cursor], entity_order, by_entity, deadline))
+      return false;
+    ++_compact_cursor;
+    if (clock::now() >= deadline && visited + 1 < _components.size())
+      return false;
+  }
+  return true;
+}
+
+size_t ecs::next_resource_id() noexcept {
+  static std::atomic_size_t next = 0;
+  return next++;
+}
+
+world_view ecs::view() {
+  const auto count = component_base::type_count();
+  if (count != 0)
+    storage(id_t{count - 1});
+  while (_component_locks.size() < count)
+    _component_locks.emplace_back();
+  return world_view(*this);
+}
+
+size_t world_view::entity_count() const noexcept {
+  return _world->_entities.size();
+}
+
+uint32_t ecs::change_tick() const noexcept {
+  return _tick;
+}
+
+void ecs::mark_changed(entity_handle handle, id_t cid) {
+  access_component_impl(handle, cid);
 }
 
 void ecs::update(duration_type delta, system_list& list) {
   std::vector<component_base*> multi_components;
-  std::vector<std::vector<std::byte>*> component_arrays;
+  std::vector<component_storage*> component_arrays;
+
+#ifdef RNU_ECS_PROFILING
+  if (_profiler)
+    _profiler->begin_frame();
+#endif
 
   std::for_each(list.begin(), list.end(), [&](std::reference_wrapper<system_base>& item) {
-    item.get().pre_update();
-    const auto& component_types = item.get().types();
-    if (component_types.size() == 1) {
-      const auto size = component_base::type_size(component_types[0]);
-      auto& arr = _components[component_types[0]];
-      for (auto ci = 0ull; ci < arr.size(); ci += size) {
-        auto* c = reinterpret_cast<component_base*>(&arr[ci]);
-        item.get().update(delta, &c);
+    auto& system = item.get();
+    system._world = this;
+#ifdef RNU_ECS_PROFILING
+    const auto pre_update_start = ecs_profiler::clock::now();
+#endif
+    system.pre_update();
+#ifdef RNU_ECS_PROFILING
+    const auto update_start = ecs_profiler::clock::now();
+#endif
+    [[maybe_unused]] size_t processed = 0;
+    const auto& component_types = system.types();
+    if (system.chunked()) {
+      processed = update_chunked_system(system, delta, component_types, multi_components, component_arrays);
+    } else if (component_types.size() == 1) {
+      auto& store = storage(component_types[0]);
+      const auto only_changed = system.flags()[0].has(component_flag::changed);
+      const auto writes = !system.flags()[0].has(component_flag::read_only);
+      for (auto ci = 0u; ci < store.size(); ++ci) {
+        if (only_changed && store.changed_tick(ci) <= system._last_update_tick)
+          continue;
+        auto* c = store.at(ci);
+        system.update(delta, &c);
+        ++processed;
+        if (writes)
+          store.set_changed_tick(ci, _tick);
       }
     } else {
-      update_multi_system(item.get(), delta, component_types, multi_components, component_arrays);
+      processed = update_multi_system(system, delta, component_types, multi_components, component_arrays);
     }
-    item.get().post_update();
+#ifdef RNU_ECS_PROFILING
+    const auto post_update_start = ecs_profiler::clock::now();
+#endif
+    system.post_update();
+    system._last_update_tick = _tick++;
+
+#ifdef RNU_ECS_PROFILING
+    if (_profiler)
+      _profiler->record(ecs_profiler::system_record{&system, system.name(), 0, pre_update_start,
+          update_start - pre_update_start, post_update_start - update_start,
+          ecs_profiler::clock::now() - post_update_start, processed});
+#endif
   });
+
+  for (auto& events : _event_streams)
+    if (events)
+      events->update();
+
+#ifdef RNU_ECS_PROFILING
+  if (_profiler)
+    _profiler->end_frame();
+#endif
+}
+
+#ifdef RNU_ECS_PROFILING
+void ecs::set_profiler(ecs_profiler* profiler) noexcept {
+  _profiler = profiler;
 }
+#endif
 
 void ecs::update(double delta_seconds, system_list& list) {
   update(duration_type(delta_seconds), list);
 }
 
-void ecs::delete_component(id_t id, size_t index) {
-  auto& component_arr = _components[id];
-  const auto deleter = component_base::get_deleter(id);
-  const auto size = component_base::type_size(id);
-  auto source_index = component_arr.size() - size;
+component_storage& ecs::storage(id_t id) {
+  if (_components.size() <= static_cast<size_t>(id)) {
+    // Create all registered storages at once, so references into _components stay valid for longer.
+    const auto count = std::max(component_base::type_count(), static_cast<size_t>(id) + 1);
+    _components.reserve(count);
+    while (_components.size() < count) _components.emplace_back(id_t{_components.size()});
+  }
+  return _components[static_cast<size_t>(id)];
+}
 
-  const auto dst = reinterpret_cast<component_base*>(&component_arr[index]);
-  const auto src = reinterpret_cast<component_base*>(&component_arr[source_index]);
-  deleter(dst);
+void ecs::swap_components(component_storage& store, uint32_t a, uint32_t b) {
+  store.swap(a, b);
+  store.link(index_of(store.at(a)->entity), a);
+  store.link(index_of(store.at(b)->entity), b);
+}
 
-  if (index == source_index) {
-    component_arr.resize(source_index);
-    return;
-  }
+ecs::clock::time_point ecs::deadline_of(duration_type budget) {
+  if (budget >= std::chrono::duration_cast<duration_type>(clock::time_point::max() - clock::now()))
+    return clock::time_point::max();
+  return clock::now() + std::chrono::duration_cast<clock::duration>(budget);
+}
 
-  memcpy(dst, src, size);
+const component_storage* ecs::find_storage(id_t id) const noexcept {
+  return static_cast<size_t>(id) < _components.size() ? &_components[static_cast<size_t>(id)] : nullptr;
+}
 
-  auto& components = as_entity(src->entity);
-  if (const auto it = std::find_if(components.begin(), components.end(),
-          [&](const auto& p) { return p.first == id && p.second == source_index; });
-      it != components.end()) {
-    it->second = static_cast<uint32_t>(index);
-  }
-  component_arr.resize(source_index);
+void ecs::delete_component(id_t id, uint32_t entity_index) {
+  if (id == hierarchy::id)
+    on_hierarchy_removed(entity_index);
+  if (const auto events = component_events(_removed_events, id))
+    events->send(static_cast<entity_handle>(_entities[entity_index]));
+  auto& store = storage(id);
+  if (static_cast<size_t>(id) < _shared_pools.size() && _shared_pools[static_cast<size_t>(id)])
+    _shared_pools[static_cast<size_t>(id)]->release(store.find(entity_index));
+  const auto index = store.index_of(entity_index);
+  if (const auto moved = store.erase(entity_index))
+    store.link(index_of(moved->entity), index);
 }
 
 bool ecs::remove_component_impl(entity_handle e, id_t component_id) {
-  auto& components = as_entity(e);
-  if (const auto it = std::find_if(components.begin(), components.end(),
-          [&](const auto& p) { return p.first == component_id; });
-      it != components.end()) {
-    for (auto& l : _listeners)
-      for (const auto id : l->component_ids())
-        if (id == component_id) {
-          l->on_remove_component({this, e}, id);
-          break;
-        }
-
-    const auto src_index = components.size() - 1;
-    const auto dst_index = std::distance(components.begin(), it);
-    delete_component(it->first, it->second);
-    components[dst_index] = components[src_index];
-    components.pop_back();
-    return true;
-  }
-  return false;
+  if (!has_component(e, component_id))
+    return false;
+  const auto index = index_of(e);
+
+  for (auto& l : _listeners)
+    if (listens_to(*l, component_id))
+      l->on_remove_component({this, e}, component_id);
+
+  delete_component(component_id, index);
+  as_entity(e).reset(component_id);
+  return true;
 }
 
 void ecs::add_component_impl(entity_handle e, id_t component_id, const component_base* component) {
   auto ent = as_entity_ptr(e);
-  const auto create = component_base::get_creator(component_id);
-  ent->second.emplace_back(component_id, static_cast<uint32_t>(create(_components[component_id], e, component)));
+  storage(component_id).emplace(ent->first, e, component, _tick);
+  ent->second.set(component_id);
+  if (const auto events = component_events(_added_events, component_id))
+    events->send(e);
   for (auto& l : _listeners)
-    for (const auto id : l->component_ids())
-      if (id == component_id) {
-        l->on_add_component({this, e}, id);
-        break;
-      }
+    if (listens_to(*l, component_id))
+      l->on_add_component({this, e}, component_id);
 }
 
-component_base* ecs::get_component_impl(entity_handle e, std::vector<std::byte>& carr, id_t component_id) {
-  auto& components = as_entity(e);
-  if (const auto it = std::find_if(components.begin(), components.end(),
-          [&](const auto& p) { return p.first == component_id; });
-      it != components.end()) {
-    return reinterpret_cast<component_base*>(&carr[it->second]);
+component_base* ecs::get_component_impl(entity_handle e, id_t component_id) {
+  if (static_cast<size_t>(component_id) >= _components.size())
+    return nullptr;
+  return _components[static_cast<size_t>(component_id)].find(index_of(e));
+}
+
+component_base* ecs::access_component_impl(entity_handle e, id_t component_id) {
+  if (static_cast<size_t>(component_id) >= _components.size())
+    return nullptr;
+  auto& store = _components[static_cast<size_t>(component_id)];
+  const auto element = store.index_of(index_of(e));
+  if (element == component_storage::npos)
+    return nullptr;
+  store.set_changed_tick(element, _tick);
+  return store.at(element);
+}
+
+ptrdiff_t ecs::driving_component(const std::vector<id_t>& types, const std::vector<component_flags>& flags) const {
+  const auto d = std::distance(types.begin(),
+      std::min_element(types.begin(), types.end(), [&](const id_t& a, const id_t& b) {
+        const auto a_opt =
+            (flags[std::distance(types.data(), &a)] & component_flag::optional) == component_flag::optional;
+        const auto b_opt =
+            (flags[std::distance(types.data(), &b)] & component_flag::optional) == component_flag::optional;
+
+        if (a_opt)
+          return false;
+        if (b_opt)
+          return true;
+        return _components[static_cast<size_t>(a)].size() < _components[static_cast<size_t>(b)].size();
+      }));
+  if (static_cast<unsigned long long>(d) == types.size())
+    return 0ll;
+  return d;
+}
+
+size_t ecs::update_chunked_system(system_base& system, duration_type delta, const std::vector<id_t>& types,
+    std::vector<component_base*>& components, std::vector<component_storage*>& component_arrays) {
+  const auto& system_flags = system.flags();
+
+  components.resize(std::max(types.size(), components.size()));
+  component_arrays.resize(std::max(component_arrays.size(), components.size()));
+  for (auto i = 0ull; i < types.size(); ++i) storage(types[i]);
+  for (auto i = 0ull; i < types.size(); ++i) component_arrays[i] = &storage(types[i]);
+
+  const auto min_index = driving_component(types, system_flags);
+  const auto& driver = *component_arrays[min_index];
+  const auto& required = system.signature();
+  const auto last_tick = system._last_update_tick;
+
+  // A chunk is a run of driving components whose entities also have all other components at consecutive elements.
+  std::vector<uint32_t> first(types.size());
+  std::vector<uint32_t> elements(types.size());
+  uint32_t run = 0;
+  size_t processed = 0;
+  const auto flush = [&] {
+    if (run == 0)
+      return;
+    for (auto j = 0ull; j < types.size(); ++j) components[j] = component_arrays[j]->at(first[j]);
+    system.update_chunk(delta, run, components.data());
+    for (auto j = 0ull; j < types.size(); ++j)
+      if (!system_flags[j].has(component_flag::read_only))
+        for (auto k = 0u; k < run; ++k) component_arrays[j]->set_changed_tick(first[j] + k, _tick);
+    processed += run;
+    run = 0;
+  };
+
+  for (auto ci = 0u; ci < driver.size(); ++ci) {
+    const auto parent_entity = as_entity_ptr(driver.at(ci)->entity);
+    const auto accepted = parent_entity->second.contains(required) && [&] {
+      for (auto j = 0ull; j < types.size(); ++j) {
+        elements[j] = component_arrays[j]->index_of(parent_entity->first);
+        if (elements[j] == component_storage::npos ||
+            (system_flags[j].has(component_flag::changed) && component_arrays[j]->changed_tick(elements[j]) <= last_tick))
+          return false;
+      }
+      return true;
+    }();
+
+    if (!accepted) {
+      flush();
+      continue;
+    }
+    for (auto j = 0ull; j < types.size() && run != 0; ++j)
+      if (elements[j] != first[j] + run)
+        flush();
+    if (run == 0)
+      first = elements;
+    ++run;
   }
-  return nullptr;
+  flush();
+  return processed;
 }
 
-void ecs::update_multi_system(system_base& system, duration_type delta, const std::vector<id_t>& types,
-    std::vector<component_base*>& components, std::vector<std::vector<std::byte>*>& component_arrays) {
+size_t ecs::update_multi_system(system_base& system, duration_type delta, const std::vector<id_t>& types,
+    std::vector<component_base*>& components, std::vector<component_storage*>& component_arrays) {
   const auto& system_flags = system.flags();
 
   components.resize(std::max(types.size(), components.size()));
   component_arrays.resize(std::max(component_arrays.size(), components.size()));
-  for (auto i = 0ull; i < types.size(); ++i) component_arrays[i] = &_components[types[i]];
-
-  const auto min_index = [&]() -> ptrdiff_t {
-    const auto d = std::distance(types.begin(),
-        std::min_element(types.begin(), types.end(), [&](const id_t& a, const id_t& b) {
-          const auto sa = component_base::type_size(a);
-          const auto sb = component_base::type_size(b);
-          const auto a_opt =
-              (system_flags[std::distance(types.data(), &a)] & component_flag::optional) == component_flag::optional;
-          const auto b_opt =
-              (system_flags[std::distance(types.data(), &b)] & component_flag::optional) == component_flag::optional;
-
-          if (a_opt)
-            return false;
-          if (b_opt)
-            return true;
-          return (_components.at(a).size() / sa < _components.at(b).size() / sb);
-        }));
-    if (static_cast<unsigned long long>(d) == types.size())
-      return 0ll;
-    return d;
-  }();
-
-  const auto size = component_base::type_size(types[min_index]);
-  for (auto ci = 0ull; ci < component_arrays[min_index]->size(); ci += size) {
-    components[min_index] = reinterpret_cast<component_base*>(&(*component_arrays[min_index])[ci]);
-    const auto& parent_entity = components[min_index]->entity;
-
-    if ([&]() -> bool {
-          for (auto j = 0ll; j < static_cast<int64_t>(types.size()); ++j) {
-            if (j == min_index)
-              continue;
-            components[j] = get_component_impl(parent_entity, *component_arrays[j], types[j]);
-            if (!components[j] && (system_flags[j] & component_flag::optional) != component_flag::optional)
-              return false;
-          }
+  for (auto i = 0ull; i < types.size(); ++i) storage(types[i]);
+  for (auto i = 0ull; i < types.size(); ++i) component_arrays[i] = &storage(types[i]);
+
+  const auto min_index = driving_component(types, system_flags);
+
+  const auto& required = system.signature();
+  const auto last_tick = system._last_update_tick;
+  std::vector<uint32_t> elements(types.size());
+  size_t processed = 0;
+  for (auto ci = 0u; ci < component_arrays[min_index]->size(); ++ci) {
+    const auto parent_entity = as_entity_ptr(component_arrays[min_index]->at(ci)->entity);
+    if (!parent_entity->second.contains(required))
+      continue;
+
+    const auto unchanged = [&] {
+      for (auto j = 0ull; j < types.size(); ++j) {
+        elements[j] = component_arrays[j]->index_of(parent_entity->first);
+        if (system_flags[j].has(component_flag::changed) &&
+            (elements[j] == component_storage::npos || component_arrays[j]->changed_tick(elements[j]) <= last_tick))
           return true;
-        }())
-      system.update(delta, components.data());
+      }
+      return false;
+    }();
+    if (unchanged)
+      continue;
+
+    for (auto j = 0ull; j < types.size(); ++j)
+      components[j] = elements[j] == component_storage::npos ? nullptr : component_arrays[j]->at(elements[j]);
+    system.update(delta, components.data());
+    ++processed;
+
+    for (auto j = 0ull; j < types.size(); ++j)
+      if (elements[j] != component_storage::npos && !system_flags[j].has(component_flag::read_only))
+        component_arrays[j]->set_changed_tick(elements[j], _tick);
+  }
+  return processed;
+}
+
+event_stream<entity_handle>* ecs::component_events(
+    const std::vector<event_stream<entity_handle>*>& streams, id_t id) noexcept {
+  return static_cast<size_t>(id) < streams.size() ? streams[static_cast<size_t>(id)] : nullptr;
+}
+
+indexed_entity* ecs::allocate_entity() {
+  if (_free_entities.empty())
+    return new indexed_entity();
+  const auto e = _free_entities.back();
+  _free_entities.pop_back();
+  return e;
+}
+
+void ecs::release_entity(uint32_t index) {
+  const auto e = _entities[index];
+  e->second.clear();
+  _free_entities.push_back(e);
+
+  const auto last = static_cast<uint32_t>(_entities.size() - 1);
+  if (index != last) {
+    // The last entity takes over the index, so its sparse entries have to follow.
+    const auto moved = _entities[last];
+    moved->second.for_each([&](id_t id) { storage(id).relink(last, index); });
+    _entities[index] = moved;
+    moved->first = index;
   }
+  _entities.pop_back();
+}
+
+bool ecs::listens_to(const listener& l, const entity_info& info) {
+  return info.contains(l.signature());
+}
+
+bool ecs::listens_to(const listener& l, id_t component_id) {
+  return l.signature().test(component_id);
 }
 
 indexed_entity* ecs::as_entity_ptr(entity_handle handle) {
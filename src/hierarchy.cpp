@@ -0,0 +1,110 @@
+#include <rnu/ecs/ecs.hpp>
+#include <algorithm>
+
+namespace rnu {
+bool ecs::set_parent(entity_handle child, entity_handle parent) {
+  // Checked before anything is modified, a cycle would make every later depth update loop forever.
+  for (auto ancestor = parent; ancestor; ancestor = parent_of(ancestor))
+    if (ancestor == child)
+      return false;
+
+  const hierarchy root;
+  if (!has_component<hierarchy>(child))
+    add_component_impl(child, hierarchy::id, &root);
+  if (parent && !has_component<hierarchy>(parent))
+    add_component_impl(parent, hierarchy::id, &root);
+
+  // Components may have been relocated by the insertions above, so look them up afterwards.
+  auto& node = *hierarchy_of(child);
+  if (node.parent == parent)
+    return true;
+
+  detach(node);
+  if (parent) {
+    auto& parent_node = *hierarchy_of(parent);
+    node.parent = parent;
+    node.next_sibling = parent_node.first_child;
+    if (parent_node.first_child)
+      hierarchy_of(parent_node.first_child)->prev_sibling = child;
+    parent_node.first_child = child;
+    set_depth(child, parent_node.depth + 1);
+  } else {
+    set_depth(child, 0);
+  }
+  return true;
+}
+
+entity_handle ecs::parent_of(entity_handle handle) const {
+  const auto* store = find_storage(hierarchy::id);
+  const auto* node = store ? store->find(index_of(handle)) : nullptr;
+  return node ? node->as<hierarchy>().parent : null_entity;
+}
+
+hierarchy* ecs::hierarchy_of(entity_handle handle) {
+  return static_cast<hierarchy*>(access_component_impl(handle, hierarchy::id));
+}
+
+void ecs::detach(hierarchy& node) {
+  if (!node.parent)
+    return;
+  if (node.prev_sibling)
+    hierarchy_of(node.prev_sibling)->next_sibling = node.next_sibling;
+  else
+    hierarchy_of(node.parent)->first_child = node.next_sibling;
+  if (node.next_sibling)
+    hierarchy_of(node.next_sibling)->prev_sibling = node.prev_sibling;
+  node.parent = null_entity;
+  node.prev_sibling = null_entity;
+  node.next_sibling = null_entity;
+}
+
+void ecs::set_depth(entity_handle root, uint32_t depth) {
+  std::vector<std::pair<entity_handle, uint32_t>> pending{{root, depth}};
+  while (!pending.empty()) {
+    const auto [handle, d] = pending.back();
+    pending.pop_back();
+    auto& node = *hierarchy_of(handle);
+    node.depth = d;
+    for (auto c = node.first_child; c; c = hierarchy_of(c)->next_sibling) pending.emplace_back(c, d + 1);
+  }
+  // Depths changed in place, the storage has to be sorted again.
+  storage(hierarchy::id).set_sorted_count(reinterpret_cast<uintptr_t>(&detail::sort_order_tag<hierarchy_depth_less>), 0);
+}
+
+void ecs::on_hierarchy_removed(uint32_t entity_index) {
+  const auto handle = static_cast<entity_handle>(_entities[entity_index]);
+  auto& node = *hierarchy_of(handle);
+  detach(node);
+  for (auto c = std::exchange(node.first_child, null_entity); c;) {
+    auto& child = *hierarchy_of(c);
+    const auto next = child.next_sibling;
+    child.parent = null_entity;
+    child.prev_sibling = null_entity;
+    child.next_sibling = null_entity;
+    set_depth(c, 0);
+    c = next;
+  }
+}
+
+void ecs::sort_hierarchy() {
+  sort_by<hierarchy>(hierarchy_depth_less{});
+
+  const auto& nodes = storage(hierarchy::id);
+  const auto size = static_cast<uint32_t>(nodes.size());
+  _hierarchy_levels.assign(1, 0);
+  while (_hierarchy_levels.back() < size) {
+    // Binary search for the end of the current level.
+    const auto depth = nodes.at(_hierarchy_levels.back())->as<hierarchy>().depth;
+    auto low = _hierarchy_levels.back();
+    auto high = size;
+    while (low < high) {
+      const auto mid = low + (high - low) / 2;
+      if (nodes.at(mid)->as<hierarchy>().depth <= depth)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+    _hierarchy_levels.push_back(low);
+  }
+}
+} // namespace rnu
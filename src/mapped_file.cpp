@@ -0,0 +1,137 @@
+#include <rnu/mapped_file.hpp>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rnu
+{
+  mapped_file::mapped_file(std::filesystem::path const& path)
+  {
+#ifdef _WIN32
+    m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+      m_file = nullptr;
+      return;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+    {
+      close();
+      return;
+    }
+    m_size = static_cast<std::size_t>(size.QuadPart);
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping)
+      m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    m_descriptor = ::open(path.c_str(), O_RDONLY);
+    if (m_descriptor < 0)
+      return;
+
+    struct stat info;
+    if (::fstat(m_descriptor, &info) != 0 || info.st_size == 0)
+    {
+      close();
+      return;
+    }
+    m_size = static_cast<std::size_t>(info.st_size);
+
+    void* const data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_descriptor, 0);
+    if (data != MAP_FAILED)
+    {
+      ::madvise(data, m_size, MADV_SEQUENTIAL);
+      m_data = data;
+    }
+#endif
+
+    if (!m_data)
+      close();
+  }
+
+  mapped_file::mapped_file(mapped_file&& other) noexcept
+  {
+    *this = std::move(other);
+  }
+
+  mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+  {
+    if (this != &other)
+    {
+      close();
+      m_data = std::exchange(other.m_data, nullptr);
+      m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+      m_file = std::exchange(other.m_file, nullptr);
+      m_mapping = std::exchange(other.m_mapping, nullptr);
+#else
+      m_descriptor = std::exchange(other.m_descriptor, -1);
+#endif
+    }
+    return *this;
+  }
+
+  mapped_file::~mapped_file()
+  {
+    close();
+  }
+
+  bool mapped_file::is_open() const noexcept
+  {
+    return m_data != nullptr;
+  }
+
+  mapped_file::operator bool() const noexcept
+  {
+    return is_open();
+  }
+
+  std::span<std::byte const> mapped_file::bytes() const noexcept
+  {
+    return { static_cast<std::byte const*>(m_data), m_size };
+  }
+
+  std::span<char const> mapped_file::chars() const noexcept
+  {
+    return { static_cast<char const*>(m_data), m_size };
+  }
+
+  std::size_t mapped_file::size() const noexcept
+  {
+    return m_size;
+  }
+
+  void mapped_file::close() noexcept
+  {
+#ifdef _WIN32
+    if (m_data)
+      UnmapViewOfFile(m_data);
+    if (m_mapping)
+      CloseHandle(m_mapping);
+    if (m_file)
+      CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if (m_data)
+      ::munmap(const_cast<void*>(m_data), m_size);
+    if (m_descriptor >= 0)
+      ::close(m_descriptor);
+    m_descriptor = -1;
+#endif
+    m_data = nullptr;
+    m_size = 0;
+  }
+}
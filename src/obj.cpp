@@ -1,6 +1,12 @@
 #include <rnu/obj.hpp>
+#include <rnu/mapped_file.hpp>
+#include <rnu/parallel.hpp>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
 #include <fstream>
 #include <sstream>
+#include <string_view>
 #include <unordered_map>
 #include <bit>
 
@@ -93,186 +99,445 @@ namespace rnu
       });
   }
 
-  std::expected<std::vector<object_t>, loading_error> load_obj(std::filesystem::path const& obj_file)
+  namespace
   {
-    std::vector<object_t> result;
-
-    size_t pos_index_offset = 1;
-    size_t tex_index_offset = 1;
-    size_t nor_index_offset = 1;
-
-    if (!exists(obj_file))
-      return std::unexpected(loading_error::file_not_found);
+    constexpr bool is_blank(char c) noexcept
+    {
+      return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
 
-    std::ifstream in(obj_file, std::ios::binary | std::ios::ate);
+    // Cuts the next line off "text", without the line break.
+    std::string_view next_line(std::string_view& text) noexcept
+    {
+      auto const end = text.find('\n');
+      auto const line = text.substr(0, end);
+      text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+      return line;
+    }
 
-    std::streamsize size = in.tellg();
-    in.seekg(0, std::ios::beg);
+    // Cuts the next whitespace separated token off "line", empty if there is none.
+    std::string_view next_token(std::string_view& line) noexcept
+    {
+      auto begin = line.begin();
+      while (begin != line.end() && is_blank(*begin))
+        ++begin;
+      auto end = begin;
+      while (end != line.end() && !is_blank(*end))
+        ++end;
+      auto const token = std::string_view(begin, end);
+      line.remove_prefix(static_cast<size_t>(end - line.begin()));
+      return token;
+    }
 
-    std::string buffer(size, ' ');
-    in.read(buffer.data(), size);
-    std::stringstream fstream(buffer);
-    in.close();
+    // Parses the next float of "line" like operator>> would, returns false if there is none.
+    bool next_float(std::string_view& line, float& value) noexcept
+    {
+      auto const token = next_token(line);
+      auto const* begin = token.data();
+      auto const* const end = begin + token.size();
+      if (begin != end && *begin == '+')
+        ++begin;
+      auto const [ptr, error] = std::from_chars(begin, end, value);
+      return error == std::errc{} && ptr != begin;
+    }
 
-    object_t intermediate_obj;
+    // Parses an integer at "ptr" like strtol, 0 if there is none.
+    int next_index(char const*& ptr, char const* end) noexcept
+    {
+      if (ptr != end && *ptr == '+')
+        ++ptr;
+      int value = 0;
+      auto const [next, error] = std::from_chars(ptr, end, value);
+      if (error == std::errc{})
+        ptr = next;
+      return value;
+    }
 
-    std::unordered_map<std::string, std::shared_ptr<material_t>> mtllib;
-    std::shared_ptr<material_t> current_material = make_default_material();
+    // Position, texcoord and normal index of "p", "p/t", "p//n" or "p/t/n", missing indices are 0.
+    std::array<int, 3> read_face_vertex(std::string_view vertex) noexcept
+    {
+      char const* ptr = vertex.data();
+      char const* const end = ptr + vertex.size();
+      std::array<int, 3> indices{};
+      for (auto& index : indices)
+      {
+        index = next_index(ptr, end);
+        if (ptr != end) ++ptr;
+      }
+      return indices;
+    }
 
-    int object_counter = 0;
+    // Indices count from 1 across all objects, or back from the end of the current object if negative.
+    unsigned resolve_index(int index, size_t count, size_t offset) noexcept
+    {
+      if (index < 0) return static_cast<unsigned>(count + index);
+      else if (index != 0) return static_cast<unsigned>(index - offset);
+      else return index;
+    }
 
-    for (std::string line; std::getline(fstream, line);)
+    // Resolves a face vertex of an object with the given attribute counts and index offsets.
+    bool resolve_face_vertex(std::array<int, 3> const& indices, std::array<size_t, 3> const& counts,
+      std::array<size_t, 3> const& offsets, obj_face& v) noexcept
     {
-      std::stringstream line_stream(line);
+      for (int i = 0; i < 3; ++i)
+        v[i] = resolve_index(indices[i], counts[i], offsets[i]);
+      return v[2] <= 10000000;
+    }
 
-      while ((line_stream.peek() == ' ' || line_stream.peek() == '\t') && !line_stream.eof())
-        line_stream.ignore();
+    // Maps the whole file. Empty files are valid OBJ files without objects, mapped_file does not open those.
+    std::expected<mapped_file, loading_error> map_obj_file(std::filesystem::path const& obj_file)
+    {
+      if (!exists(obj_file))
+        return std::unexpected(loading_error::file_not_found);
+
+      mapped_file file(obj_file);
+      std::error_code error;
+      if (!file.is_open() && (file_size(obj_file, error) != 0 || error))
+        return std::unexpected(loading_error::read_failed);
+      return file;
+    }
 
-      std::string identifier;
-      line_stream >> identifier;
+    // Statement of a chunk that changes the object structure, replayed in file order after all chunks are parsed.
+    struct obj_record
+    {
+      enum kind_t
+      {
+        object,
+        group,
+        use_material,
+        material_library,
+        faces,
+      };
+
+      kind_t kind;
+      // Name, or all library files for material_library. Points into the parsed text.
+      std::string_view argument;
+      // Vertex attributes of the chunk before a run of faces, in the order of obj_chunk::counts.
+      std::array<size_t, 3> counts{};
+      size_t first_face = 0;
+      size_t face_count = 0;
+    };
+
+    // Vertex data and faces of a range of whole lines, indices are not resolved yet.
+    struct obj_chunk
+    {
+      std::string_view text;
+      std::vector<obj_vec3> positions;
+      std::vector<obj_vec2> texcoords;
+      std::vector<obj_vec3> normals;
+      std::vector<std::array<int, 3>> face_vertices;
+      // End of every face in face_vertices.
+      std::vector<size_t> face_ends;
+      std::vector<obj_record> records;
+
+      std::array<size_t, 3> counts() const noexcept
+      {
+        return { positions.size(), texcoords.size(), normals.size() };
+      }
+    };
 
-      if (identifier == "mtllib")
+    void parse_chunk(obj_chunk& chunk)
+    {
+      for (auto text = chunk.text; !text.empty();)
       {
-        mtllib.clear();
-        while (!line_stream.eof())
+        auto line = next_line(text);
+        auto const identifier = next_token(line);
+
+        if (identifier == "v")
         {
-          std::string mtllib_file;
-          line_stream >> mtllib_file;
-          auto x = load_mtllib(obj_file.parent_path() / mtllib_file);
-          mtllib.insert(x.begin(), x.end());
+          auto& arr = chunk.positions.emplace_back();
+          next_float(line, arr[0]) && next_float(line, arr[1]) && next_float(line, arr[2]);
         }
-      }
-      else if (identifier == "usemtl")
-      {
-        std::string name;
-        line_stream >> name;
-        current_material = mtllib[name];
-        if (result.back().groups.empty() || !result.back().groups.back().faces.empty())
+        else if (identifier == "vn")
         {
-          result.back().groups.emplace_back().name = name;
+          auto& arr = chunk.normals.emplace_back();
+          next_float(line, arr[0]) && next_float(line, arr[1]) && next_float(line, arr[2]);
         }
-        result.back().groups.back().material = current_material;
-      }
-      else if (identifier == "o")
-      {
-        if (!result.empty())
+        else if (identifier == "vt")
         {
-          pos_index_offset += result.back().positions.size();
-          tex_index_offset += result.back().texcoords.size();
-          nor_index_offset += result.back().normals.size();
+          auto& arr = chunk.texcoords.emplace_back();
+          next_float(line, arr[0]) && next_float(line, arr[1]);
         }
-
-        line_stream >> result.emplace_back().name;
-        continue;
-      }
-      else if (identifier == "g")
-      {
-        std::string name;
-        line_stream >> name;
-        if (result.empty())
+        else if (identifier == "f")
         {
-          result.emplace_back();
-          result.back().name = name;
+          // Faces without vertex data between them only differ in their indices and share one record.
+          auto const counts = chunk.counts();
+          if (chunk.records.empty() || chunk.records.back().kind != obj_record::faces || chunk.records.back().counts != counts)
+            chunk.records.push_back({ .kind = obj_record::faces, .argument = {}, .counts = counts, .first_face = chunk.face_ends.size(), .face_count = 0 });
+          ++chunk.records.back().face_count;
+
+          for (auto vertex = next_token(line); !vertex.empty(); vertex = next_token(line))
+            chunk.face_vertices.push_back(read_face_vertex(vertex));
+          chunk.face_ends.push_back(chunk.face_vertices.size());
+        }
+        else if (identifier == "o")
+        {
+          chunk.records.push_back({ .kind = obj_record::object, .argument = next_token(line) });
+        }
+        else if (identifier == "g")
+        {
+          chunk.records.push_back({ .kind = obj_record::group, .argument = next_token(line) });
+        }
+        else if (identifier == "usemtl")
+        {
+          chunk.records.push_back({ .kind = obj_record::use_material, .argument = next_token(line) });
+        }
+        else if (identifier == "mtllib")
+        {
+          chunk.records.push_back({ .kind = obj_record::material_library, .argument = line });
         }
-        auto& next = result.back().groups.emplace_back();
-        next.name = std::move(name);
-        next.material = current_material;
-        continue;
       }
-      else if (identifier == "v")
+    }
+
+    // Splits "text" into about "count" chunks of whole lines.
+    std::vector<obj_chunk> split_chunks(std::string_view text, size_t count)
+    {
+      std::vector<obj_chunk> chunks;
+      for (; !text.empty(); --count)
       {
-        auto& arr = intermediate_obj.positions.emplace_back();
-        line_stream >> arr[0];
-        line_stream >> arr[1];
-        line_stream >> arr[2];
-        continue;
+        // Cut after the first line break behind the target size, the last chunk takes the rest.
+        auto const target = count <= 1 ? text.size() : std::max<size_t>(1, text.size() / count);
+        auto const end = text.find('\n', target - 1);
+        auto const size = end == std::string_view::npos ? text.size() : end + 1;
+        chunks.emplace_back().text = text.substr(0, size);
+        text.remove_prefix(size);
       }
-      else if (identifier == "vn")
+      return chunks;
+    }
+
+    // Runs of faces whose indices resolve against the same object state, converted in parallel.
+    struct obj_face_batch
+    {
+      obj_chunk const* chunk;
+      obj_record const* record;
+      size_t object;
+      size_t group;
+      // Index of the first face in the group.
+      size_t first_face;
+      std::array<size_t, 3> counts;
+      std::array<size_t, 3> offsets;
+    };
+
+    // Where the vertex data of an object lies in the concatenated data of all chunks.
+    struct obj_ranges
+    {
+      std::array<size_t, 3> begin{};
+      std::array<size_t, 3> end{};
+
+      std::array<size_t, 3> counts() const noexcept
       {
-        auto& arr = intermediate_obj.normals.emplace_back();
-        line_stream >> arr[0];
-        line_stream >> arr[1];
-        line_stream >> arr[2];
-        continue;
+        return { end[0] - begin[0], end[1] - begin[1], end[2] - begin[2] };
       }
-      else if (identifier == "vt")
+    };
+
+    template<typename T>
+    void copy_range(std::vector<obj_chunk> const& chunks, std::vector<T> obj_chunk::* attribute,
+      std::vector<std::array<size_t, 3>> const& chunk_offsets, size_t index, size_t begin, size_t end, std::vector<T>& out)
+    {
+      out.reserve(end - begin);
+      for (size_t c = 0; c < chunks.size() && begin < end; ++c)
       {
-        auto& arr = intermediate_obj.texcoords.emplace_back();
-        line_stream >> arr[0];
-        line_stream >> arr[1];
-        continue;
+        auto const& data = chunks[c].*attribute;
+        auto const first = chunk_offsets[c][index];
+        if (begin >= first + data.size())
+          continue;
+        auto const from = begin - first;
+        auto const to = std::min(end - first, data.size());
+        out.insert(out.end(), data.begin() + from, data.begin() + to);
+        begin = first + to;
       }
-      else if (identifier == "f")
-      {
-        if (result.back().groups.empty())
-          result.back().groups.emplace_back().name = "Default";
+    }
 
-        if (!intermediate_obj.positions.empty())
-        {
-          result.back().positions.insert(result.back().positions.end(), intermediate_obj.positions.begin(), intermediate_obj.positions.end());
-          intermediate_obj.positions.clear();
-        }
-        if (!intermediate_obj.normals.empty())
+    // Builds the objects from parsed chunks, like a sequential pass over the whole text would.
+    // "for_each(count, fun)" calls "fun(i)" for every i below count, possibly in parallel.
+    template<typename ForEach>
+    std::expected<std::vector<object_t>, loading_error> assemble_objects(std::vector<obj_chunk> const& chunks,
+      std::filesystem::path const& mtl_directory, ForEach&& for_each)
+    {
+      // Offsets of every chunk in the concatenated vertex data.
+      std::vector<std::array<size_t, 3>> chunk_offsets(chunks.size());
+      for (size_t c = 1; c < chunks.size(); ++c)
+        for (int i = 0; i < 3; ++i)
+          chunk_offsets[c][i] = chunk_offsets[c - 1][i] + chunks[c - 1].counts()[i];
+
+      // Replays the structure in file order. Vertex data is moved into the current object at every face, so every
+      // object takes a contiguous range of it, starting at what was flushed before.
+      std::vector<object_t> result;
+      std::vector<obj_ranges> ranges;
+      std::vector<obj_face_batch> batches;
+      std::array<size_t, 3> flushed{};
+      std::array<size_t, 3> index_offsets{ 1, 1, 1 };
+
+      std::unordered_map<std::string, std::shared_ptr<material_t>> mtllib;
+      std::shared_ptr<material_t> current_material = make_default_material();
+
+      auto const current_object = [&]() -> object_t& {
+        if (result.empty())
         {
-          result.back().normals.insert(result.back().normals.end(), intermediate_obj.normals.begin(), intermediate_obj.normals.end());
-          intermediate_obj.normals.clear();
+          result.emplace_back();
+          ranges.emplace_back();
         }
-        if (!intermediate_obj.texcoords.empty())
+        return result.back();
+      };
+
+      for (size_t c = 0; c < chunks.size(); ++c)
+      {
+        auto const& chunk = chunks[c];
+        for (auto const& record : chunk.records)
         {
-          result.back().texcoords.insert(result.back().texcoords.end(), intermediate_obj.texcoords.begin(), intermediate_obj.texcoords.end());
-          intermediate_obj.texcoords.clear();
+          switch (record.kind)
+          {
+          case obj_record::faces:
+          {
+            auto& object = current_object();
+            auto& range = ranges.back();
+            if (object.groups.empty())
+              object.groups.emplace_back().name = "Default";
+
+            for (int i = 0; i < 3; ++i)
+            {
+              auto const seen = chunk_offsets[c][i] + record.counts[i];
+              if (seen == flushed[i])
+                continue;
+              if (range.begin[i] == range.end[i])
+                range.begin[i] = flushed[i];
+              range.end[i] = flushed[i] = seen;
+            }
+
+            auto& faces = object.groups.back().faces;
+            batches.push_back({ .chunk = &chunk, .record = &record, .object = result.size() - 1, .group = object.groups.size() - 1,
+              .first_face = faces.size(), .counts = range.counts(), .offsets = index_offsets });
+            faces.resize(faces.size() + record.face_count);
+            break;
+          }
+          case obj_record::object:
+            if (!result.empty())
+            {
+              auto const counts = ranges.back().counts();
+              for (int i = 0; i < 3; ++i)
+                index_offsets[i] += counts[i];
+            }
+            result.emplace_back().name = record.argument;
+            ranges.emplace_back();
+            break;
+          case obj_record::group:
+          {
+            std::string name(record.argument);
+            if (result.empty())
+            {
+              current_object().name = name;
+            }
+            auto& next = result.back().groups.emplace_back();
+            next.name = std::move(name);
+            next.material = current_material;
+            break;
+          }
+          case obj_record::use_material:
+          {
+            std::string name(record.argument);
+            current_material = mtllib[name];
+            auto& object = current_object();
+            if (object.groups.empty() || !object.groups.back().faces.empty())
+            {
+              object.groups.emplace_back().name = name;
+            }
+            object.groups.back().material = current_material;
+            break;
+          }
+          case obj_record::material_library:
+          {
+            mtllib.clear();
+            auto files = record.argument;
+            for (auto mtllib_file = next_token(files); !mtllib_file.empty(); mtllib_file = next_token(files))
+            {
+              auto x = load_mtllib(mtl_directory / mtllib_file);
+              mtllib.insert(x.begin(), x.end());
+            }
+            break;
+          }
+          }
         }
+      }
 
-        auto& face = result.back().groups.back().faces.emplace_back();
-        line_stream.ignore();
-        for (std::string vertex; std::getline(line_stream, vertex, ' ');)
-        {
-          if (std::ranges::all_of(vertex, [](char c) { return std::isspace(c); }))
-            continue;
+      for_each(result.size(), [&](size_t o) {
+        auto const& range = ranges[o];
+        copy_range(chunks, &obj_chunk::positions, chunk_offsets, 0, range.begin[0], range.end[0], result[o].positions);
+        copy_range(chunks, &obj_chunk::texcoords, chunk_offsets, 1, range.begin[1], range.end[1], result[o].texcoords);
+        copy_range(chunks, &obj_chunk::normals, chunk_offsets, 2, range.begin[2], range.end[2], result[o].normals);
+      });
 
-          auto& v = face.vertices.emplace_back();
+      std::atomic_bool invalid_normals = false;
+      for_each(batches.size(), [&](size_t b) {
+        auto const& batch = batches[b];
+        auto const& chunk = *batch.chunk;
+        auto& faces = result[batch.object].groups[batch.group].faces;
+        for (size_t f = 0; f < batch.record->face_count; ++f)
+        {
+          auto const face = batch.record->first_face + f;
+          auto const first = face == 0 ? 0 : chunk.face_ends[face - 1];
+          auto& vertices = faces[batch.first_face + f].vertices;
+          vertices.resize(chunk.face_ends[face] - first);
+          for (size_t v = 0; v < vertices.size(); ++v)
+          {
+            if (!resolve_face_vertex(chunk.face_vertices[first + v], batch.counts, batch.offsets, vertices[v]))
+              invalid_normals.store(true, std::memory_order_relaxed);
+          }
+        }
+      });
+      if (invalid_normals.load(std::memory_order_relaxed))
+        return std::unexpected(loading_error::invalid_normals_detected);
 
-          int p = 0;
-          int t = 0;
-          int n = 0;
+      for (auto& o : result)
+      {
+        if (o.texcoords.empty())
+          o.texcoords.push_back({ 0, 0 });
+        if (o.normals.empty())
+          o.normals.push_back({ 0, 1, 0 });
+      }
 
-          char* ptr = vertex.data();
-          char* begin = ptr;
-          p = std::strtol(ptr, &ptr, 10);
-          ++ptr;
-          t = std::strtol(ptr, &ptr, 10);
-          ++ptr;
-          n = std::strtol(ptr, &ptr, 10);
+      return result;
+    }
+  }
 
-          if (p < 0) v[0] = static_cast<unsigned>(result.back().positions.size() + p);
-          else if (p != 0) v[0] = static_cast<unsigned>(p - pos_index_offset);
-          else v[0] = p;
+  std::expected<std::vector<object_t>, loading_error> load_obj(std::filesystem::path const& obj_file)
+  {
+    auto const file = map_obj_file(obj_file);
+    if (!file)
+      return std::unexpected(file.error());
+    return load_obj(file->chars(), obj_file.parent_path());
+  }
 
-          if (t < 0) v[1] = static_cast<unsigned>(result.back().texcoords.size() + t);
-          else if (t != 0) v[1] = static_cast<unsigned>(t - tex_index_offset);
-          else v[1] = t;
+  std::expected<std::vector<object_t>, loading_error> load_obj(std::span<char const> obj_data, std::filesystem::path const& mtl_directory)
+  {
+    std::vector<obj_chunk> chunks(1);
+    chunks[0].text = std::string_view(obj_data.data(), obj_data.size());
+    parse_chunk(chunks[0]);
+    return assemble_objects(chunks, mtl_directory, [](size_t count, auto const& fun) {
+      for (size_t i = 0; i < count; ++i)
+        fun(i);
+    });
+  }
 
-          if (n < 0) v[2] = static_cast<unsigned>(result.back().normals.size() + n);
-          else if (n != 0) v[2] = static_cast<unsigned>(n - nor_index_offset);
-          else v[2] = n;
+  std::expected<std::vector<object_t>, loading_error> load_obj(std::filesystem::path const& obj_file, thread_pool& pool)
+  {
+    auto const file = map_obj_file(obj_file);
+    if (!file)
+      return std::unexpected(file.error());
+    return load_obj(file->chars(), obj_file.parent_path(), pool);
+  }
 
-          if (v[2] > 10000000)
-          {
-            return std::unexpected(loading_error::invalid_normals_detected);
-          }
-        }
-      }
-    }
+  std::expected<std::vector<object_t>, loading_error> load_obj(std::span<char const> obj_data, std::filesystem::path const& mtl_directory, thread_pool& pool)
+  {
+    // Small enough that every worker gets a few chunks of large files, large enough that small files are one chunk.
+    constexpr size_t min_chunk_size = 1 << 20;
+    auto const chunk_count = std::clamp<size_t>(obj_data.size() / min_chunk_size, 1, 4 * std::max(1u, pool.concurrency()));
 
-    for (auto& o : result)
-    {
-      if (o.texcoords.empty())
-        o.texcoords.push_back({ 0, 0 });
-      if (o.normals.empty())
-        o.normals.push_back({ 0, 1, 0 });
-    }
+    auto chunks = split_chunks(std::string_view(obj_data.data(), obj_data.size()), chunk_count);
+    parallel_for(pool, size_t(0), chunks.size(), [&](size_t c) { parse_chunk(chunks[c]); }, 1);
 
-    return result;
+    return assemble_objects(chunks, mtl_directory, [&](size_t count, auto const& fun) {
+      parallel_for(pool, size_t(0), count, fun, 1);
+    });
   }
 
   using face_identifier = std::tuple<obj_vec3, obj_vec3, obj_vec2>;
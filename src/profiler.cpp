@@ -0,0 +1,80 @@
+#include <rnu/ecs/profiler.hpp>
+
+namespace rnu {
+namespace {
+  void write_escaped(std::ostream& out, std::string_view str) {
+    for (const auto c : str) {
+      if (c == '"' || c == '\\')
+        out << '\\';
+      out << c;
+    }
+  }
+
+  void write_event(std::ostream& out, bool& first, std::string_view name, std::string_view suffix, double start_us,
+      double duration_us, const size_t* entities) {
+    out << (first ? "\n" : ",\n") << R"(  {"cat":"ecs","ph":"X","pid":0,"tid":0,"name":")";
+    write_escaped(out, name);
+    write_escaped(out, suffix);
+    out << R"(","ts":)" << start_us << R"(,"dur":)" << duration_us;
+    if (entities)
+      out << R"(,"args":{"entities":)" << *entities << "}";
+    out << "}";
+    first = false;
+  }
+} // namespace
+
+ecs_profiler::ecs_profiler(size_t max_frames) : _max_frames(max_frames) {}
+
+void ecs_profiler::begin_frame() {
+  _frame_start = clock::now();
+}
+
+void ecs_profiler::end_frame() {
+  _frames.push_back(frame_record{_frame++, _frame_start, clock::now() - _frame_start});
+  while (_frames.size() > _max_frames) {
+    const auto dropped = _frames.front().frame;
+    _frames.pop_front();
+    while (!_systems.empty() && _systems.front().frame == dropped) _systems.pop_front();
+  }
+}
+
+void ecs_profiler::record(const system_record& record) {
+  _systems.push_back(record);
+  _systems.back().frame = _frame;
+}
+
+void ecs_profiler::clear() {
+  _systems.clear();
+  _frames.clear();
+}
+
+const std::deque<ecs_profiler::system_record>& ecs_profiler::systems() const noexcept {
+  return _systems;
+}
+
+const std::deque<ecs_profiler::frame_record>& ecs_profiler::frames() const noexcept {
+  return _frames;
+}
+
+void ecs_profiler::write_chrome_trace(std::ostream& out) const {
+  using us = std::chrono::duration<double, std::micro>;
+  const auto since_epoch = [&](clock::time_point t) { return us(t - _epoch).count(); };
+
+  bool first = true;
+  out << R"({"displayTimeUnit":"ms","traceEvents":[)";
+  for (const auto& frame : _frames)
+    write_event(out, first, "ecs::update", "", since_epoch(frame.start), us(frame.duration).count(), nullptr);
+
+  for (const auto& s : _systems) {
+    const auto start = since_epoch(s.start);
+    const auto pre = us(s.pre_update).count();
+    const auto update = us(s.update).count();
+    const auto post = us(s.post_update).count();
+    write_event(out, first, s.name, "", start, pre + update + post, &s.entities);
+    write_event(out, first, s.name, "::pre_update", start, pre, nullptr);
+    write_event(out, first, s.name, "::update", start + pre, update, &s.entities);
+    write_event(out, first, s.name, "::post_update", start + pre + update, post, nullptr);
+  }
+  out << "\n]}\n";
+}
+} // namespace rnu
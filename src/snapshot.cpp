@@ -0,0 +1,315 @@
+#include <rnu/ecs/ecs.hpp>
+#include <rnu/mapped_file.hpp>
+#include <algorithm>
+#include <fstream>
+#include <optional>
+
+namespace rnu {
+namespace {
+  constexpr char snapshot_magic[8]{'r', 'n', 'u', 'e', 'c', 's', 0, 0};
+  constexpr uint32_t snapshot_version = 2;
+  // Sections and component arrays start at this alignment, so a mapped snapshot could be read in place.
+  constexpr size_t snapshot_alignment = 64;
+
+  struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t entity_count;
+  };
+  // The header is followed by the number of components of every entity as uint32_t. This bounds the entity count by
+  // the input size and is checked against the owners of all sections.
+
+  // One section per non-empty component storage, followed by the owning entity index per component and the payload.
+  struct snapshot_section {
+    uint64_t type;
+    uint64_t size;
+    uint64_t alignment;
+    uint64_t count;
+    uint64_t serialized;
+    uint64_t payload_size;
+  };
+
+  struct pending_section {
+    snapshot_section section;
+    std::span<const std::byte> owners;
+    std::span<const std::byte> payload;
+    // Serialized components are decoded before the current state is replaced, so a broken payload changes nothing.
+    std::optional<component_storage> decoded;
+  };
+
+  // Hierarchy links are stored as entity index + 1, with 0 for null, and resolved again when loading.
+  template <typename Fun> void for_each_link(hierarchy& node, Fun&& fun) {
+    fun(node.parent);
+    fun(node.first_child);
+    fun(node.next_sibling);
+    fun(node.prev_sibling);
+  }
+
+  uint32_t uint32_at(std::span<const std::byte> values, size_t index) {
+    uint32_t value;
+    std::memcpy(&value, values.data() + index * sizeof(uint32_t), sizeof(uint32_t));
+    return value;
+  }
+
+  // The links have to form a forest, set_parent and set_depth would loop forever on a cycle. Every link has to point to
+  // an entity with a hierarchy component, every child list has to hold exactly the children of its parent and every
+  // depth has to be its parent's depth + 1, which also rules out cycles in the parent links.
+  bool valid_hierarchy(
+      std::span<const std::byte> owners, std::span<const std::byte> payload, size_t count, size_t entity_count) {
+    constexpr auto none = std::numeric_limits<uint32_t>::max();
+    std::vector<hierarchy> nodes(count);
+    std::vector<uint32_t> node_of(entity_count, none);
+    for (auto ci = 0ull; ci < count; ++ci) {
+      std::memcpy(static_cast<void*>(&nodes[ci]), payload.data() + ci * sizeof(hierarchy), sizeof(hierarchy));
+      node_of[uint32_at(owners, ci)] = static_cast<uint32_t>(ci);
+    }
+
+    bool valid = true;
+    const auto resolve = [&](entity_handle link) {
+      const auto index = reinterpret_cast<uintptr_t>(link);
+      if (index == 0)
+        return none;
+      if (index > entity_count || node_of[index - 1] == none)
+        valid = false;
+      return valid ? node_of[index - 1] : none;
+    };
+    std::vector<uint32_t> parents(count);
+    std::vector<uint32_t> child_counts(count);
+    for (auto ci = 0ull; ci < count && valid; ++ci) {
+      parents[ci] = resolve(nodes[ci].parent);
+      for_each_link(nodes[ci], [&](entity_handle& link) { resolve(link); });
+      if (valid && parents[ci] != none)
+        ++child_counts[parents[ci]];
+    }
+    if (!valid)
+      return false;
+
+    for (auto ci = 0ull; ci < count; ++ci) {
+      const auto& node = nodes[ci];
+      if (parents[ci] == none) {
+        if (node.depth != 0 || node.prev_sibling || node.next_sibling)
+          return false;
+      } else if (node.depth != nodes[parents[ci]].depth + 1) {
+        return false;
+      }
+
+      // Bounded by the number of children, so a cyclic sibling list ends the walk too.
+      auto previous = none;
+      auto visited = 0u;
+      for (auto child = resolve(node.first_child); child != none; child = resolve(nodes[child].next_sibling)) {
+        if (visited == child_counts[ci] || parents[child] != ci || resolve(nodes[child].prev_sibling) != previous)
+          return false;
+        previous = child;
+        ++visited;
+      }
+      if (visited != child_counts[ci])
+        return false;
+    }
+    return true;
+  }
+} // namespace
+
+std::expected<std::vector<std::byte>, snapshot_error> ecs::save_snapshot() const {
+  snapshot_header header{};
+  std::copy(std::begin(snapshot_magic), std::end(snapshot_magic), header.magic);
+  header.version = snapshot_version;
+  header.entity_count = _entities.size();
+
+  for (auto i = 0ull; i < _components.size(); ++i) {
+    if (_components[i].empty())
+      continue;
+    const auto& info = component_base::type_info(id_t{i});
+    // Shared values live outside of the storages and would be lost.
+    const auto shared = i < _shared_pools.size() && _shared_pools[i];
+    if ((!info.saver && !info.trivially_copyable) || shared)
+      return std::unexpected(snapshot_error::not_serializable);
+    ++header.section_count;
+  }
+
+  std::vector<std::byte> data;
+  snapshot_writer writer(data);
+  writer.write(header);
+  for (const auto e : _entities) writer.write(static_cast<uint32_t>(e->second.count()));
+
+  for (auto i = 0ull; i < _components.size(); ++i) {
+    const auto& store = _components[i];
+    if (store.empty())
+      continue;
+    const auto& info = component_base::type_info(id_t{i});
+
+    writer.align(snapshot_alignment);
+    const auto section_offset = writer.offset();
+    snapshot_section section{i, info.size, info.alignment, store.size(), info.saver != nullptr, 0};
+    writer.write(section);
+
+    for (auto ci = 0u; ci < store.size(); ++ci) writer.write(index_of(store.at(ci)->entity));
+    writer.align(snapshot_alignment);
+
+    const auto payload_offset = writer.offset();
+    if (info.saver) {
+      for (auto ci = 0u; ci < store.size(); ++ci) info.saver(store.at(ci), writer);
+    } else if (id_t{i} == hierarchy::id) {
+      for (auto ci = 0u; ci < store.size(); ++ci) {
+        auto node = store.at(ci)->as<hierarchy>();
+        for_each_link(node, [](entity_handle& link) {
+          link = reinterpret_cast<entity_handle>(link ? uintptr_t(index_of(link)) + 1 : 0);
+        });
+        writer.write(node);
+      }
+    } else
+      writer.write(store.at(0), store.size() * info.size);
+
+    section.payload_size = writer.offset() - payload_offset;
+    writer.write_at(section_offset, section);
+  }
+  return data;
+}
+
+std::expected<void, snapshot_error> ecs::save_snapshot(const std::filesystem::path& path) const {
+  const auto data = save_snapshot();
+  if (!data)
+    return std::unexpected(data.error());
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+    return std::unexpected(snapshot_error::file_not_found);
+  file.write(reinterpret_cast<const char*>(data->data()), data->size());
+  return {};
+}
+
+std::expected<void, snapshot_error> ecs::load_snapshot(std::span<const std::byte> data) {
+  snapshot_reader reader(data);
+  const auto header = reader.read<snapshot_header>();
+  if (reader.failed() || !std::equal(std::begin(snapshot_magic), std::end(snapshot_magic), header.magic) ||
+      header.version != snapshot_version || header.entity_count > std::numeric_limits<uint32_t>::max())
+    return std::unexpected(snapshot_error::invalid_format);
+  if (header.entity_count > (data.size() - reader.offset()) / sizeof(uint32_t))
+    return std::unexpected(snapshot_error::invalid_format);
+  const auto component_counts = reader.read_bytes(header.entity_count * sizeof(uint32_t));
+
+  // Every section takes at least its header, a larger count can only come from a corrupt file.
+  if (header.section_count > data.size() / sizeof(snapshot_section))
+    return std::unexpected(snapshot_error::invalid_format);
+
+  // Validate and decode everything before touching the current state.
+  std::vector<pending_section> sections;
+  sections.reserve(header.section_count);
+  std::vector<uint32_t> owners;
+  std::vector<uint32_t> owned(header.entity_count);
+  for (auto si = 0u; si < header.section_count; ++si) {
+    auto& pending = sections.emplace_back();
+    reader.align(snapshot_alignment);
+    pending.section = reader.read<snapshot_section>();
+    const auto& section = pending.section;
+    if (reader.failed() || section.count > data.size() / sizeof(uint32_t))
+      return std::unexpected(snapshot_error::invalid_format);
+    pending.owners = reader.read_bytes(section.count * sizeof(uint32_t));
+    reader.align(snapshot_alignment);
+    pending.payload = reader.read_bytes(section.payload_size);
+    if (reader.failed())
+      return std::unexpected(snapshot_error::invalid_format);
+
+    const id_t type{section.type};
+    if (!component_base::is_valid(type))
+      return std::unexpected(snapshot_error::type_mismatch);
+    const auto& info = component_base::type_info(type);
+    if (info.size != section.size || info.alignment != section.alignment ||
+        (section.serialized ? !info.loader : !info.trivially_copyable))
+      return std::unexpected(snapshot_error::type_mismatch);
+    if (!section.serialized && section.payload_size != section.count * section.size)
+      return std::unexpected(snapshot_error::invalid_format);
+    const auto duplicate_type = std::any_of(sections.begin(), sections.end() - 1,
+        [&](const pending_section& other) { return other.section.type == section.type; });
+    if (duplicate_type)
+      return std::unexpected(snapshot_error::invalid_format);
+
+    // Every entity owns at most one component of a type.
+    owners.resize(section.count);
+    for (auto ci = 0ull; ci < section.count; ++ci) owners[ci] = uint32_at(pending.owners, ci);
+    std::sort(owners.begin(), owners.end());
+    if (std::adjacent_find(owners.begin(), owners.end()) != owners.end() ||
+        (!owners.empty() && owners.back() >= header.entity_count))
+      return std::unexpected(snapshot_error::invalid_format);
+    for (const auto owner : owners) ++owned[owner];
+
+    if (section.serialized) {
+      auto& decoded = pending.decoded.emplace(type);
+      decoded.append_uninitialized(section.count, _tick);
+      snapshot_reader payload(pending.payload);
+      for (auto ci = 0ull; ci < section.count; ++ci) info.loader(decoded.at(static_cast<uint32_t>(ci)), payload);
+      if (payload.failed())
+        return std::unexpected(snapshot_error::invalid_format);
+    } else if (type == hierarchy::id &&
+               !valid_hierarchy(pending.owners, pending.payload, section.count, header.entity_count)) {
+      return std::unexpected(snapshot_error::invalid_format);
+    }
+  }
+  for (auto i = 0ull; i < header.entity_count; ++i)
+    if (owned[i] != uint32_at(component_counts, i))
+      return std::unexpected(snapshot_error::invalid_format);
+
+  std::vector<entity> previous;
+  previous.reserve(_entities.size());
+  for (const auto e : _entities) previous.push_back(entity{this, static_cast<entity_handle>(e)});
+  delete_entities(previous);
+
+  _entities.reserve(header.entity_count);
+  for (auto i = 0ull; i < header.entity_count; ++i) {
+    const auto e = allocate_entity();
+    e->first = static_cast<uint32_t>(i);
+    _entities.push_back(e);
+  }
+
+  for (auto& pending : sections) {
+    const auto& section = pending.section;
+    const id_t type{section.type};
+    auto& store = storage(type);
+    // All storages are empty after deleting the previous entities.
+    uint32_t first = 0;
+    if (pending.decoded)
+      store = std::move(*pending.decoded);
+    else if (section.count != 0) {
+      first = store.append_uninitialized(section.count, _tick);
+      std::memcpy(store.at(first), pending.payload.data(), pending.payload.size());
+    }
+
+    for (auto ci = 0ull; ci < section.count; ++ci) {
+      const auto owner = uint32_at(pending.owners, ci);
+      const auto element = static_cast<uint32_t>(first + ci);
+      store.at(element)->entity = static_cast<entity_handle>(_entities[owner]);
+      store.link(owner, element);
+      _entities[owner]->second.set(type);
+    }
+    if (const auto events = component_events(_added_events, type))
+      for (auto ci = 0ull; ci < section.count; ++ci)
+        events->send(static_cast<entity_handle>(_entities[uint32_at(pending.owners, ci)]));
+
+    if (type == hierarchy::id) {
+      for (auto ci = 0ull; ci < section.count; ++ci)
+        for_each_link(store.at(static_cast<uint32_t>(first + ci))->as<hierarchy>(), [&](entity_handle& link) {
+          const auto index = reinterpret_cast<uintptr_t>(link);
+          link = index == 0 ? null_entity : static_cast<entity_handle>(_entities[index - 1]);
+        });
+    }
+  }
+
+  std::vector<entity> matching;
+  for (auto& l : _listeners) {
+    matching.clear();
+    for (const auto e : _entities)
+      if (listens_to(*l, e->second))
+        matching.push_back(entity{this, static_cast<entity_handle>(e)});
+    if (!matching.empty())
+      l->on_add_batch(matching);
+  }
+  return {};
+}
+
+std::expected<void, snapshot_error> ecs::load_snapshot(const std::filesystem::path& path) {
+  const mapped_file file(path);
+  if (!file)
+    return std::unexpected(snapshot_error::file_not_found);
+  return load_snapshot(file.bytes());
+}
+} // namespace rnu
@@ -1,14 +1,23 @@
 #include <rnu/ecs/system.hpp>
 #include <execution>
+#include <typeinfo>
 
 namespace rnu {
 void system_base::add_component_type(id_t id, component_flags flags) {
   _component_types.push_back(id);
   _component_flags.push_back(flags);
+  if ((flags & component_flag::optional) != component_flag::optional)
+    _signature.set(id);
 }
 
 void system_base::update(duration_type delta, component_base** components) const {}
 
+void system_base::update_chunk(duration_type delta, size_t count, component_base** components) const {}
+
+std::string_view system_base::name() const {
+  return typeid(*this).name();
+}
+
 const std::vector<id_t>& system_base::types() const {
   return _component_types;
 }
@@ -17,6 +26,22 @@ const std::vector<component_flags>& system_base::flags() const {
   return _component_flags;
 }
 
+const component_signature& system_base::signature() const {
+  return _signature;
+}
+
+bool system_base::chunked() const noexcept {
+  return _chunked;
+}
+
+void system_base::set_chunked(bool chunked) noexcept {
+  _chunked = chunked;
+}
+
+ecs& system_base::world() const noexcept {
+  return *_world;
+}
+
 void system_list::add(system_base& system) {
   _systems.push_back(std::ref(system));
 }
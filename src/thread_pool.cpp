@@ -0,0 +1,51 @@
+#include <rnu/thread_pool.hpp>
+#include <algorithm>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#elif defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace rnu::detail
+{
+  void configure_worker_thread(std::string_view name, unsigned index, std::optional<unsigned> cpu)
+  {
+    if (!name.empty())
+    {
+      auto full_name = std::string(name) + " " + std::to_string(index);
+#ifdef _WIN32
+      SetThreadDescription(GetCurrentThread(), std::wstring(full_name.begin(), full_name.end()).c_str());
+#elif defined(__linux__)
+      // Linux limits thread names to 15 characters.
+      full_name.resize(std::min<size_t>(full_name.size(), 15));
+      pthread_setname_np(pthread_self(), full_name.c_str());
+#elif defined(__APPLE__)
+      // Apple only names the calling thread.
+      pthread_setname_np(full_name.c_str());
+#endif
+    }
+
+    if (cpu)
+    {
+#ifdef _WIN32
+      if (*cpu < sizeof(DWORD_PTR) * 8)
+        SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << *cpu);
+#elif defined(__linux__)
+      if (*cpu < CPU_SETSIZE)
+      {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(*cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      }
+#else
+      // No portable affinity api on other platforms, the option is ignored there.
+#endif
+    }
+  }
+}
@@ -0,0 +1,181 @@
+#include <rnu/thread_pool_profiler.hpp>
+#include <algorithm>
+#include <bit>
+
+namespace rnu
+{
+  void latency_histogram::add(duration d) noexcept
+  {
+    auto const us = static_cast<uint64_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(d).count()));
+    auto const bucket = std::min<size_t>(std::bit_width(us), bucket_count - 1);
+    ++buckets[bucket];
+    ++count;
+    total += d;
+    max = std::max(max, d);
+  }
+
+  void latency_histogram::merge(latency_histogram const& other) noexcept
+  {
+    for (size_t i = 0; i < bucket_count; ++i)
+      buckets[i] += other.buckets[i];
+    count += other.count;
+    total += other.total;
+    max = std::max(max, other.max);
+  }
+
+  auto latency_histogram::quantile(double q) const noexcept -> duration
+  {
+    if (count == 0)
+      return {};
+    auto const target = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i)
+    {
+      seen += buckets[i];
+      if (seen >= target)
+        return std::min<duration>(std::chrono::microseconds(uint64_t(1) << i), max);
+    }
+    return max;
+  }
+
+  auto latency_histogram::mean() const noexcept -> duration
+  {
+    return count == 0 ? duration{} : duration(total.count() / static_cast<int64_t>(count));
+  }
+
+  void thread_pool_worker_stats::merge(thread_pool_worker_stats const& other) noexcept
+  {
+    jobs_run += other.jobs_run;
+    jobs_stolen += other.jobs_stolen;
+    failed_steals += other.failed_steals;
+    max_queue_depth = std::max(max_queue_depth, other.max_queue_depth);
+    busy += other.busy;
+    idle += other.idle;
+    queue_wait.merge(other.queue_wait);
+    run_time.merge(other.run_time);
+  }
+
+  thread_pool_profiler::thread_pool_profiler(unsigned worker_count, size_t max_trace_events)
+    : m_max_trace_events(max_trace_events), m_workers(std::make_unique<worker_slot[]>(worker_count)),
+      m_worker_count(worker_count)
+  {
+  }
+
+  void thread_pool_profiler::record_job(unsigned worker, clock::time_point enqueued, clock::time_point start,
+    clock::time_point end, clock::duration nested, bool stolen, size_t queue_depth)
+  {
+    if (worker >= m_worker_count)
+      return;
+    auto& slot = m_workers[worker];
+    std::unique_lock<std::mutex> lock(slot.mutex);
+    auto& stats = slot.stats;
+    ++stats.jobs_run;
+    stats.jobs_stolen += stolen;
+    stats.max_queue_depth = std::max<uint64_t>(stats.max_queue_depth, queue_depth);
+    stats.busy += end - start - nested;
+    stats.queue_wait.add(start - enqueued);
+    stats.run_time.add(end - start);
+    push_event(slot, trace_event{ start, end, start - enqueued, queue_depth, false, stolen });
+  }
+
+  void thread_pool_profiler::record_idle(unsigned worker, clock::time_point start, clock::time_point end)
+  {
+    if (worker >= m_worker_count)
+      return;
+    auto& slot = m_workers[worker];
+    std::unique_lock<std::mutex> lock(slot.mutex);
+    slot.stats.idle += end - start;
+    push_event(slot, trace_event{ start, end, {}, 0, true, false });
+  }
+
+  void thread_pool_profiler::record_failed_steals(unsigned worker, uint64_t count)
+  {
+    if (worker >= m_worker_count)
+      return;
+    auto& slot = m_workers[worker];
+    std::unique_lock<std::mutex> lock(slot.mutex);
+    slot.stats.failed_steals += count;
+  }
+
+  void thread_pool_profiler::clear()
+  {
+    for (unsigned i = 0; i < m_worker_count; ++i)
+    {
+      std::unique_lock<std::mutex> lock(m_workers[i].mutex);
+      m_workers[i].stats = {};
+      m_workers[i].events.clear();
+    }
+  }
+
+  unsigned thread_pool_profiler::worker_count() const noexcept
+  {
+    return m_worker_count;
+  }
+
+  std::vector<thread_pool_worker_stats> thread_pool_profiler::stats() const
+  {
+    std::vector<thread_pool_worker_stats> result(m_worker_count);
+    for (unsigned i = 0; i < m_worker_count; ++i)
+    {
+      std::unique_lock<std::mutex> lock(m_workers[i].mutex);
+      result[i] = m_workers[i].stats;
+    }
+    return result;
+  }
+
+  thread_pool_worker_stats thread_pool_profiler::total() const
+  {
+    thread_pool_worker_stats result;
+    for (auto const& s : stats())
+      result.merge(s);
+    return result;
+  }
+
+  void thread_pool_profiler::push_event(worker_slot& slot, trace_event const& event)
+  {
+    if (m_max_trace_events == 0)
+      return;
+    if (slot.events.size() == m_max_trace_events)
+      slot.events.pop_front();
+    slot.events.push_back(event);
+  }
+
+  void thread_pool_profiler::write_chrome_trace(std::ostream& out) const
+  {
+    using us = std::chrono::duration<double, std::micro>;
+    auto const since_epoch = [&](clock::time_point t) { return us(t - m_epoch).count(); };
+
+    bool first = true;
+    auto const separator = [&] {
+      out << (first ? "\n" : ",\n");
+      first = false;
+    };
+
+    out << R"({"displayTimeUnit":"ms","traceEvents":[)";
+    for (unsigned i = 0; i < m_worker_count; ++i)
+    {
+      separator();
+      out << R"(  {"ph":"M","pid":0,"tid":)" << i << R"(,"name":"thread_name","args":{"name":"worker )" << i << R"("}})";
+
+      std::unique_lock<std::mutex> lock(m_workers[i].mutex);
+      for (auto const& e : m_workers[i].events)
+      {
+        separator();
+        out << R"(  {"cat":"thread_pool","ph":"X","pid":0,"tid":)" << i << R"(,"name":")"
+            << (e.idle ? "idle" : e.stolen ? "stolen job" : "job") << R"(","ts":)" << since_epoch(e.start)
+            << R"(,"dur":)" << us(e.end - e.start).count();
+        if (!e.idle)
+          out << R"(,"args":{"queue_wait_us":)" << us(e.queue_wait).count() << "}";
+        out << "}";
+
+        if (!e.idle)
+        {
+          separator();
+          out << R"(  {"cat":"thread_pool","ph":"C","pid":0,"name":"queue depth","ts":)" << since_epoch(e.start)
+              << R"(,"args":{"jobs":)" << e.queue_depth << "}}";
+        }
+      }
+    }
+    out << "\n]}\n";
+  }
+}
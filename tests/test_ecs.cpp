@@ -0,0 +1,1244 @@
+#include "catch_amalgamated.hpp"
+#include <rnu/ecs/ecs.hpp>
+#include <atomic>
+#include <optional>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace rnu;
+
+namespace
+{
+    struct position : component<position>
+    {
+        float x = 0;
+        float y = 0;
+    };
+
+    struct label : component<label>
+    {
+        std::string value;
+    };
+
+    struct opaque : component<opaque>
+    {
+        std::string value;
+    };
+
+    struct velocity : component<velocity>
+    {
+        float x = 1;
+    };
+
+    // Not trivially relocatable, it points to itself and records which instances are alive.
+    struct tracked : component<tracked>
+    {
+        tracked() { live().insert(this); }
+        tracked(const tracked& other) : component(other), value(other.value) { live().insert(this); }
+        tracked(tracked&& other) noexcept : component(other), value(std::move(other.value)) { live().insert(this); }
+        ~tracked()
+        {
+            if (live().erase(this) == 0)
+                ++destroyed_twice();
+        }
+
+        bool intact() const { return self == this && live().contains(this); }
+
+        static std::set<const tracked*>& live()
+        {
+            static std::set<const tracked*> instances;
+            return instances;
+        }
+        static int& destroyed_twice()
+        {
+            static int count = 0;
+            return count;
+        }
+
+        const tracked* self = this;
+        std::string value;
+    };
+}
+
+template <> struct rnu::component_serializer<label>
+{
+    static void save(const label& c, snapshot_writer& writer)
+    {
+        writer.write(std::string_view(c.value));
+    }
+    static label load(snapshot_reader& reader)
+    {
+        label n;
+        n.value = reader.read_string();
+        return n;
+    }
+};
+
+namespace
+{
+    position make_position(float x, float y = 0)
+    {
+        position p;
+        p.x = x;
+        p.y = y;
+        return p;
+    }
+
+    label make_label(std::string value)
+    {
+        label n;
+        n.value = std::move(value);
+        return n;
+    }
+
+    // Values of all position components in storage order.
+    std::vector<float> stored_positions(ecs& world)
+    {
+        struct collect : typed_system<const position>
+        {
+            std::vector<float>* values;
+            void update(duration_type, const position* p) const override
+            {
+                values->push_back(p->x);
+            }
+        } system;
+        std::vector<float> values;
+        system.values = &values;
+        system_list list;
+        list.add(system);
+        world.update(0.0, list);
+        return values;
+    }
+
+    struct by_x
+    {
+        bool operator()(const position& a, const position& b) const
+        {
+            return a.x < b.x;
+        }
+    };
+
+    bool ascending(const position& a, const position& b)
+    {
+        return a.x < b.x;
+    }
+
+    bool descending(const position& a, const position& b)
+    {
+        return a.x > b.x;
+    }
+
+    auto scaled_by(float factor)
+    {
+        return [factor](const position& a, const position& b) { return a.x * factor < b.x * factor; };
+    }
+
+    // Counts the entities passed to each callback, batch callbacks do not forward to the per-entity ones.
+    struct counting_listener : listener
+    {
+        explicit counting_listener(std::initializer_list<rnu::id_t> ids)
+        {
+            for (auto const id : ids)
+                add_component_id(id);
+        }
+
+        void on_add(entity) override { ++added; }
+        void on_remove(entity) override { ++removed; }
+        void on_add_batch(std::span<const entity> entities) override
+        {
+            ++add_batches;
+            added += int(entities.size());
+        }
+        void on_remove_batch(std::span<const entity> entities) override
+        {
+            ++remove_batches;
+            removed += int(entities.size());
+        }
+        void on_add_component_batch(std::span<const entity>, rnu::id_t) override
+        {
+            ++component_batches;
+        }
+
+        int added = 0;
+        int removed = 0;
+        int add_batches = 0;
+        int remove_batches = 0;
+        int component_batches = 0;
+    };
+
+    template <typename Fun> void patch(std::vector<std::byte>& data, size_t offset, Fun&& fun)
+    {
+        uint32_t value;
+        std::memcpy(&value, data.data() + offset, sizeof(value));
+        fun(value);
+        std::memcpy(data.data() + offset, &value, sizeof(value));
+    }
+}
+
+TEST_CASE("ECS batch entities")
+{
+    ecs world;
+    counting_listener moving({velocity::id});
+    counting_listener placed({position::id});
+    counting_listener named({position::id, label::id});
+    world.add_listener(moving);
+    world.add_listener(placed);
+    world.add_listener(named);
+
+    SECTION("Batches notify matching listeners once")
+    {
+        auto const batch = world.create_entities(100, make_position(2), make_label("batch"));
+        REQUIRE(batch.size() == 100);
+        for (auto& e : batch)
+        {
+            REQUIRE(e.get<position>()->x == 2);
+            REQUIRE(e.get<label>()->value == "batch");
+        }
+        REQUIRE(moving.added == 0);
+        REQUIRE(placed.add_batches == 1);
+        REQUIRE(placed.added == 100);
+        REQUIRE(placed.component_batches == 1);
+        REQUIRE(named.add_batches == 1);
+        REQUIRE(named.component_batches == 2);
+
+        world.delete_entities(std::span(batch).first(40));
+        REQUIRE(moving.removed == 0);
+        REQUIRE(placed.remove_batches == 1);
+        REQUIRE(placed.removed == 40);
+        REQUIRE(named.removed == 40);
+        REQUIRE(stored_positions(world).size() == 60);
+        for (auto& e : std::span(batch).subspan(40))
+            REQUIRE(e.get<label>()->value == "batch");
+    }
+
+    SECTION("Listeners behind a non-matching one are notified")
+    {
+        auto const e = world.create_entity(make_position(1));
+        REQUIRE(moving.added == 0);
+        REQUIRE(placed.added == 1);
+        REQUIRE(named.added == 0);
+
+        world.delete_entity(e);
+        REQUIRE(moving.removed == 0);
+        REQUIRE(placed.removed == 1);
+        REQUIRE(named.removed == 0);
+    }
+
+    SECTION("Invalid component ids create nothing")
+    {
+        auto const p = make_position(1);
+        const component_base* prototypes[]{&p};
+        rnu::id_t const invalid{component_base::type_count()};
+        REQUIRE(world.create_entities(10, prototypes, &invalid, 1).empty());
+        REQUIRE_FALSE(world.create_entity(prototypes, &invalid, 1));
+        REQUIRE(placed.added == 0);
+        REQUIRE(stored_positions(world).empty());
+    }
+}
+
+TEST_CASE("ECS component storage")
+{
+    ecs world;
+    std::mt19937 rng(7);
+
+    SECTION("Lookups after churn")
+    {
+        struct expected
+        {
+            entity e;
+            std::optional<float> x;
+            std::optional<std::string> name;
+        };
+        std::vector<expected> live;
+        for (int step = 0; step < 5000; ++step)
+        {
+            auto const op = rng() % 6;
+            if (op == 0 || live.empty())
+            {
+                auto const x = float(step);
+                auto e = step % 3 ? world.create_entity(make_position(x)) : world.create_entity(make_position(x), make_label(std::to_string(step)));
+                live.push_back({e, x, step % 3 ? std::nullopt : std::optional(std::to_string(step))});
+                continue;
+            }
+            auto const i = rng() % live.size();
+            auto& item = live[i];
+            switch (op)
+            {
+            case 1:
+                world.delete_entity(item.e);
+                item = live.back();
+                live.pop_back();
+                break;
+            case 2:
+                if (!item.x)
+                {
+                    item.e.add(make_position(float(step)));
+                    item.x = float(step);
+                }
+                break;
+            case 3:
+                REQUIRE(item.e.remove<position>() == item.x.has_value());
+                item.x.reset();
+                break;
+            case 4:
+                if (!item.name)
+                {
+                    item.e.add(make_label(std::to_string(step)));
+                    item.name = std::to_string(step);
+                }
+                break;
+            case 5:
+                REQUIRE(item.e.remove<label>() == item.name.has_value());
+                item.name.reset();
+                break;
+            }
+        }
+
+        size_t positions = 0;
+        for (auto& item : live)
+        {
+            REQUIRE(item.e.has<position>() == item.x.has_value());
+            REQUIRE(item.e.has<label>() == item.name.has_value());
+            if (item.x)
+                REQUIRE(item.e.get<position>()->x == *item.x);
+            else
+                REQUIRE(item.e.get<position>() == nullptr);
+            if (item.name)
+                REQUIRE(world.get_component<label>(item.e)->value == *item.name);
+            positions += item.x.has_value();
+        }
+        REQUIRE(stored_positions(world).size() == positions);
+    }
+
+    SECTION("Recycled entity records start empty")
+    {
+        auto const old = world.create_entity(make_position(1), make_label("old"));
+        auto const neighbour = world.create_entity(make_position(2));
+        entity_handle const handle = old;
+        world.delete_entity(old);
+
+        auto fresh = world.create_entity(velocity{});
+        REQUIRE(static_cast<entity_handle>(fresh) == handle);
+        REQUIRE_FALSE(fresh.has<position>());
+        REQUIRE_FALSE(fresh.has<label>());
+        REQUIRE(fresh.get<position>() == nullptr);
+        REQUIRE(fresh.get<velocity>() != nullptr);
+        REQUIRE(world.get_component<position>(neighbour)->x == 2);
+
+        fresh.add(make_position(3));
+        REQUIRE(fresh.get<position>()->x == 3);
+        REQUIRE(world.get_component<position>(neighbour)->x == 2);
+    }
+}
+
+TEST_CASE("ECS component signatures")
+{
+    SECTION("Bit operations")
+    {
+        component_signature wide;
+        wide.set(rnu::id_t{3});
+        wide.set(rnu::id_t{70});
+        wide.set(rnu::id_t{130});
+        component_signature narrow;
+        narrow.set(rnu::id_t{3});
+
+        REQUIRE(wide.test(rnu::id_t{70}));
+        REQUIRE_FALSE(wide.test(rnu::id_t{71}));
+        REQUIRE_FALSE(narrow.test(rnu::id_t{130}));
+        REQUIRE(wide.count() == 3);
+        REQUIRE(wide.contains(narrow));
+        REQUIRE_FALSE(narrow.contains(wide));
+        REQUIRE(narrow.intersects(wide));
+        REQUIRE(wide.contains(component_signature{}));
+
+        std::vector<size_t> ids;
+        wide.for_each([&](rnu::id_t id) { ids.push_back(size_t(id)); });
+        REQUIRE(ids == std::vector<size_t>{3, 70, 130});
+
+        wide.reset(rnu::id_t{70});
+        wide.reset(rnu::id_t{130});
+        REQUIRE(wide == narrow);
+        wide.clear();
+        REQUIRE(wide.empty());
+        REQUIRE_FALSE(wide.intersects(narrow));
+    }
+
+    SECTION("Listeners and systems")
+    {
+        ecs world;
+        counting_listener named({position::id, label::id});
+        world.add_listener(named);
+        auto placed = world.create_entity(make_position(1));
+        world.create_entity(make_position(2), make_label("two"));
+        world.create_entity(make_label("three"));
+        REQUIRE(named.added == 1);
+
+        struct optional_label : system_base
+        {
+            optional_label()
+            {
+                add_component_type<position>();
+                add_component_type<label>(component_flag::optional);
+            }
+            void update(duration_type, component_base** components) const override
+            {
+                ++visited;
+                labelled += components[1] != nullptr;
+            }
+            mutable int visited = 0;
+            mutable int labelled = 0;
+        } optional;
+        struct both : typed_system<const position, const label>
+        {
+            mutable int visited = 0;
+            void update(duration_type, const position*, const label*) const override { ++visited; }
+        } required;
+        system_list list;
+        list.add(optional);
+        list.add(required);
+        world.update(0.0, list);
+        REQUIRE(optional.visited == 2);
+        REQUIRE(optional.labelled == 1);
+        REQUIRE(required.visited == 1);
+
+        placed.add(make_label("one"));
+        placed.remove<position>();
+        world.update(0.0, list);
+        REQUIRE(optional.visited == 3);
+        REQUIRE(required.visited == 2);
+        world.delete_entity(placed);
+        REQUIRE(named.removed == 0);
+    }
+}
+
+TEST_CASE("ECS change ticks")
+{
+    struct watch : typed_system<changed<const position>>
+    {
+        mutable std::vector<float> seen;
+        void update(duration_type, const position* p) const override { seen.push_back(p->x); }
+    };
+    struct read_positions : typed_system<const position>
+    {
+        void update(duration_type, const position*) const override {}
+    };
+    struct write_positions : typed_system<position>
+    {
+        void update(duration_type, position*) const override {}
+    };
+
+    ecs world;
+    std::vector<entity> entities;
+    for (int i = 0; i < 10; ++i)
+        entities.push_back(world.create_entity(make_position(float(i))));
+
+    watch watcher;
+    read_positions reader;
+    system_list list;
+    list.add(reader);
+    list.add(watcher);
+    auto const changes = [&] {
+        watcher.seen.clear();
+        world.update(0.0, list);
+        return watcher.seen;
+    };
+
+    REQUIRE(changes().size() == 10);
+    REQUIRE(changes().empty());
+
+    SECTION("Writes are seen once")
+    {
+        entities[2].get<position>()->x = 20;
+        REQUIRE(changes() == std::vector<float>{20});
+        REQUIRE(changes().empty());
+
+        world.get_component<position>(entities[5]);
+        REQUIRE(changes() == std::vector<float>{5});
+    }
+
+    SECTION("Read only access is no change")
+    {
+        REQUIRE(std::as_const(entities[3]).get<position>()->x == 3);
+        REQUIRE(changes().empty());
+    }
+
+    SECTION("mark_changed")
+    {
+        auto const tick = world.change_tick();
+        world.mark_changed<position>(entities[4]);
+        REQUIRE(changes() == std::vector<float>{4});
+        REQUIRE(world.change_tick() > tick);
+    }
+
+    SECTION("Writing systems")
+    {
+        write_positions writer;
+        system_list writing;
+        writing.add(writer);
+        world.update(0.0, writing);
+        REQUIRE(changes().size() == 10);
+    }
+
+    SECTION("Each system keeps its own tick")
+    {
+        watch other;
+        system_list other_list;
+        other_list.add(other);
+        world.update(0.0, other_list);
+        other.seen.clear();
+
+        entities[7].get<position>()->x = 70;
+        REQUIRE(changes() == std::vector<float>{70});
+        world.update(0.0, other_list);
+        REQUIRE(other.seen == std::vector<float>{70});
+        REQUIRE(changes().empty());
+    }
+}
+
+TEST_CASE("ECS non-trivially relocatable components")
+{
+    static_assert(!traits::is_trivially_relocatable<tracked>::value);
+    auto const make_tracked = [](int i) {
+        tracked t;
+        t.value = "a string too long for the small buffer " + std::to_string(i);
+        return t;
+    };
+    auto const check = [](ecs& world, const std::vector<entity>& entities) {
+        size_t count = 0;
+        for (auto& e : entities)
+        {
+            if (!e)
+                continue;
+            auto const* t = world.get_component<tracked>(e);
+            REQUIRE(t->intact());
+            REQUIRE(t->value == "a string too long for the small buffer " + std::to_string(int(e.get<position>()->x)));
+            ++count;
+        }
+        REQUIRE(tracked::live().size() == count);
+        REQUIRE(tracked::destroyed_twice() == 0);
+    };
+
+    {
+        ecs world;
+        std::mt19937 rng(11);
+        std::vector<entity> entities;
+        for (int i = 0; i < 300; ++i)
+            entities.push_back(world.create_entity(make_position(float(i)), make_tracked(i)));
+        check(world, entities);
+
+        for (int k = 0; k < 150; ++k)
+        {
+            auto& e = entities[rng() % entities.size()];
+            if (e)
+                world.delete_entity(std::exchange(e, entity{}));
+        }
+        check(world, entities);
+
+        world.sort_by<tracked>([](const tracked& a, const tracked& b) { return a.value > b.value; });
+        check(world, entities);
+        REQUIRE(world.compact());
+        check(world, entities);
+
+        world.reserve<tracked>(4096);
+        check(world, entities);
+    }
+    REQUIRE(tracked::live().empty());
+    REQUIRE(tracked::destroyed_twice() == 0);
+}
+
+TEST_CASE("ECS snapshots")
+{
+    ecs world;
+    std::vector<entity> entities;
+    for (int i = 0; i < 50; ++i)
+    {
+        if (i % 2)
+            entities.push_back(world.create_entity(make_position(float(i)), make_label("entity " + std::to_string(i))));
+        else
+            entities.push_back(world.create_entity(make_position(float(i))));
+    }
+    world.set_parent(entities[3], entities[1]);
+
+    auto const data = world.save_snapshot();
+    REQUIRE(data);
+
+    SECTION("Round trip")
+    {
+        ecs loaded;
+        loaded.create_entity(make_position(-1));
+        REQUIRE(loaded.load_snapshot(*data));
+
+        int positions = 0;
+        int labels = 0;
+        struct check_labels : typed_system<const position, const label>
+        {
+            int* count;
+            void update(duration_type, const position* p, const label* n) const override
+            {
+                ++*count;
+                REQUIRE(n->value == "entity " + std::to_string(int(p->x)));
+            }
+        } label_system;
+        label_system.count = &labels;
+        struct count_positions : typed_system<const position>
+        {
+            int* count;
+            void update(duration_type, const position* p) const override
+            {
+                ++*count;
+                REQUIRE(p->x >= 0);
+            }
+        } position_system;
+        position_system.count = &positions;
+        system_list list;
+        list.add(label_system);
+        list.add(position_system);
+        loaded.update(0.1, list);
+        REQUIRE(positions == 50);
+        REQUIRE(labels == 25);
+    }
+
+    SECTION("Components without serializer are rejected")
+    {
+        world.create_entity(opaque{});
+        REQUIRE(world.save_snapshot().error() == snapshot_error::not_serializable);
+    }
+
+    SECTION("Corrupt input leaves the world unchanged")
+    {
+        ecs target;
+        auto const kept = target.create_entity(make_position(7));
+        auto const check_unchanged = [&] {
+            REQUIRE(target.get_component<position>(kept) != nullptr);
+            REQUIRE(target.get_component<position>(kept)->x == 7);
+        };
+
+        auto bad = *data;
+        bad[0] = std::byte{0};
+        REQUIRE(target.load_snapshot(bad).error() == snapshot_error::invalid_format);
+        check_unchanged();
+
+        // Section count right behind magic and version.
+        bad = *data;
+        patch(bad, 12, [](uint32_t& count) { count = 0xffffffffu; });
+        REQUIRE(target.load_snapshot(bad).error() == snapshot_error::invalid_format);
+        check_unchanged();
+
+        REQUIRE(target.load_snapshot(std::span(*data).first(data->size() / 2)).error() == snapshot_error::invalid_format);
+        check_unchanged();
+
+        // Entity count behind the section count, far more entities than the file can describe.
+        bad = *data;
+        patch(bad, 16, [](uint32_t& count) { count = 0xfffffff0u; });
+        REQUIRE(target.load_snapshot(bad).error() == snapshot_error::invalid_format);
+        check_unchanged();
+
+        // Component count of the first entity, which owns a position only.
+        bad = *data;
+        patch(bad, 24, [](uint32_t& count) { ++count; });
+        REQUIRE(target.load_snapshot(bad).error() == snapshot_error::invalid_format);
+        check_unchanged();
+
+        // Broken payloads and owners are detected before the previous entities are deleted.
+        ecs labelled;
+        for (int i = 0; i < 4; ++i)
+            labelled.create_entity(make_label("name " + std::to_string(i)));
+        auto const labels_data = labelled.save_snapshot();
+        REQUIRE(labels_data);
+
+        // The only section starts at the first 64 byte boundary, its owner indices follow the 48 byte section header.
+        bad = *labels_data;
+        patch(bad, 64 + 48 + 4, [](uint32_t& owner) { owner = 0; });
+        REQUIRE(target.load_snapshot(bad).error() == snapshot_error::invalid_format);
+        check_unchanged();
+
+        // Length of the last string, now reaching past the payload.
+        bad = *labels_data;
+        patch(bad, bad.size() - std::string_view("name 3").size() - sizeof(uint64_t), [](uint32_t& size) { size = 1000; });
+        REQUIRE(target.load_snapshot(bad).error() == snapshot_error::invalid_format);
+        check_unchanged();
+
+        REQUIRE(target.load_snapshot(*labels_data));
+        REQUIRE(target.get_component<position>(kept) == nullptr);
+    }
+
+    SECTION("Cyclic hierarchies are rejected")
+    {
+        ecs linked;
+        auto const root = linked.create_entity();
+        auto const child = linked.create_entity();
+        REQUIRE(linked.set_parent(child, root));
+        auto const linked_data = linked.save_snapshot();
+        REQUIRE(linked_data);
+
+        ecs target;
+        REQUIRE(target.load_snapshot(*linked_data));
+        REQUIRE(target.load_snapshot(*data));
+
+        // The hierarchy section holds the child, then the root. Its payload starts at the second 64 byte boundary.
+        // Each component starts with its entity handle, followed by the parent, child and sibling links and the depth.
+        // Links are entity indices + 1.
+        size_t const root_parent = 128 + sizeof(hierarchy) + sizeof(entity_handle);
+        auto bad = *linked_data;
+        patch(bad, root_parent, [](uint32_t& parent) { parent = 2; });
+        REQUIRE(target.load_snapshot(bad).error() == snapshot_error::invalid_format);
+        bad = *linked_data;
+        patch(bad, root_parent, [](uint32_t& parent) { parent = 1; });
+        REQUIRE(target.load_snapshot(bad).error() == snapshot_error::invalid_format);
+        // Depths are checked as well.
+        bad = *linked_data;
+        patch(bad, 128 + 5 * sizeof(entity_handle), [](uint32_t& depth) { depth = 3; });
+        REQUIRE(target.load_snapshot(bad).error() == snapshot_error::invalid_format);
+        REQUIRE(target.view().entity_count() == 50);
+    }
+
+    SECTION("Entities without components")
+    {
+        ecs sparse;
+        sparse.create_entities(5);
+        sparse.create_entity(make_position(1));
+        ecs loaded;
+        REQUIRE(loaded.load_snapshot(*sparse.save_snapshot()));
+        REQUIRE(loaded.view().entity_count() == 6);
+        REQUIRE(stored_positions(loaded) == std::vector<float>{1});
+    }
+}
+
+TEST_CASE("ECS profiler")
+{
+    struct move : typed_system<position, const velocity>
+    {
+        void update(duration_type, position* p, const velocity* v) const override { p->x += v->x; }
+        std::string_view name() const override { return "move \"fast\""; }
+    } system;
+
+    SECTION("Frames and export")
+    {
+        ecs_profiler profiler(2);
+        for (int frame = 0; frame < 3; ++frame)
+        {
+            profiler.begin_frame();
+            auto const now = ecs_profiler::clock::now();
+            profiler.record({&system, system.name(), 0, now, std::chrono::microseconds(1), std::chrono::microseconds(2),
+                std::chrono::microseconds(3), size_t(10 + frame)});
+            profiler.end_frame();
+        }
+        REQUIRE(profiler.frames().size() == 2);
+        REQUIRE(profiler.frames().front().frame == 1);
+        REQUIRE(profiler.systems().size() == 2);
+        REQUIRE(profiler.systems().front().entities == 11);
+
+        std::ostringstream out;
+        profiler.write_chrome_trace(out);
+        auto const trace = out.str();
+        REQUIRE(trace.starts_with(R"({"displayTimeUnit":"ms","traceEvents":[)"));
+        REQUIRE(trace.find(R"("name":"move \"fast\"::update")") != std::string::npos);
+        REQUIRE(trace.find(R"("args":{"entities":12})") != std::string::npos);
+
+        profiler.clear();
+        REQUIRE(profiler.frames().empty());
+        REQUIRE(profiler.systems().empty());
+    }
+
+#ifdef RNU_ECS_PROFILING
+    SECTION("Recorded updates")
+    {
+        ecs world;
+        world.create_entities(20, position{}, velocity{});
+        world.create_entities(5, position{});
+        system_list list;
+        list.add(system);
+        ecs_profiler profiler;
+        world.set_profiler(&profiler);
+        world.update(0.0, list);
+        world.update(0.0, list);
+        world.set_profiler(nullptr);
+        world.update(0.0, list);
+
+        REQUIRE(profiler.frames().size() == 2);
+        REQUIRE(profiler.systems().size() == 2);
+        auto const& record = profiler.systems().back();
+        REQUIRE(record.system == &system);
+        REQUIRE(record.frame == 1);
+        REQUIRE(record.entities == 20);
+    }
+#endif
+}
+
+TEST_CASE("ECS chunk systems")
+{
+    struct move : chunk_system<position, const velocity>
+    {
+        mutable std::vector<size_t> chunks;
+        void update(duration_type, std::span<position> p, std::span<const velocity> v) const override
+        {
+            chunks.push_back(p.size());
+            for (size_t i = 0; i < p.size(); ++i)
+                p[i].x += v[i].x;
+        }
+    } system;
+    struct move_changed : chunk_system<changed<position>, const velocity>
+    {
+        mutable std::vector<size_t> chunks;
+        void update(duration_type, std::span<position> p, std::span<const velocity>) const override
+        {
+            chunks.push_back(p.size());
+        }
+    } changed_system;
+
+    ecs world;
+    auto const first = world.create_entities(100, make_position(0), velocity{});
+    auto const still = world.create_entities(10, make_position(0));
+    auto const last = world.create_entities(10, make_position(0), velocity{});
+    system_list list;
+    list.add(system);
+
+    SECTION("Entities lacking a component split the chunks")
+    {
+        // The velocity storage drives, its last 10 elements continue after the position-only entities.
+        world.update(0.0, list);
+        REQUIRE(system.chunks == std::vector<size_t>{100, 10});
+        for (auto& e : first)
+            REQUIRE(e.get<position>()->x == 1);
+        for (auto& e : still)
+            REQUIRE(e.get<position>()->x == 0);
+        for (auto& e : last)
+            REQUIRE(e.get<position>()->x == 1);
+    }
+
+    SECTION("Matching entity order gives a single chunk")
+    {
+        world.delete_entities(still);
+        REQUIRE(world.compact());
+        world.update(0.0, list);
+        REQUIRE(system.chunks == std::vector<size_t>{110});
+    }
+
+    SECTION("Unchanged components split the chunks")
+    {
+        system_list changes;
+        changes.add(changed_system);
+        world.update(0.0, changes);
+        REQUIRE(changed_system.chunks == std::vector<size_t>{100, 10});
+
+        changed_system.chunks.clear();
+        world.get_component<position>(first[50])->x = 1;
+        world.get_component<position>(first[51])->x = 1;
+        world.get_component<position>(first[80])->x = 1;
+        world.get_component<position>(last[9])->x = 1;
+        world.update(0.0, changes);
+        REQUIRE(changed_system.chunks == std::vector<size_t>{2, 1, 1});
+    }
+}
+
+TEST_CASE("ECS sorting and compaction")
+{
+    ecs world;
+    std::mt19937 rng(3);
+    std::vector<entity> entities;
+    for (int i = 0; i < 500; ++i)
+    {
+        auto const x = float(rng() % 1000);
+        entities.push_back(world.create_entity(make_position(x), make_label(std::to_string(int(x)))));
+    }
+    for (size_t i = 0; i < entities.size(); i += 2)
+        entities[i].add(velocity{});
+    for (size_t i = 0; i < entities.size(); i += 7)
+        world.delete_entity(entities[i]);
+
+    auto const check_consistent = [&] {
+        for (auto& e : entities)
+            if (e.has<position>())
+                REQUIRE(e.get<label>()->value == std::to_string(int(e.get<position>()->x)));
+    };
+
+    SECTION("Full sort")
+    {
+        REQUIRE(world.sort_by<position>(by_x{}));
+        auto const values = stored_positions(world);
+        REQUIRE(std::is_sorted(values.begin(), values.end()));
+        check_consistent();
+    }
+
+    SECTION("Writes invalidate the sorted range")
+    {
+        REQUIRE(world.sort_by<position>(by_x{}));
+        entities[1].get<position>()->x = -1;
+        REQUIRE(world.sort_by<position>(by_x{}));
+        auto const values = stored_positions(world);
+        REQUIRE(values.front() == -1);
+        REQUIRE(std::is_sorted(values.begin(), values.end()));
+    }
+
+    SECTION("Comparators of the same type")
+    {
+        REQUIRE(world.sort_by<position>(&ascending));
+        REQUIRE(world.sort_by<position>(&descending));
+        auto const values = stored_positions(world);
+        REQUIRE(std::is_sorted(values.rbegin(), values.rend()));
+
+        REQUIRE(world.sort_by<position>(scaled_by(1)));
+        REQUIRE(world.sort_by<position>(scaled_by(-1)));
+        auto const again = stored_positions(world);
+        REQUIRE(std::is_sorted(again.rbegin(), again.rend()));
+    }
+
+    SECTION("Budgeted sort")
+    {
+        while (!world.sort_by<position>(by_x{}, std::chrono::microseconds(1)))
+            ;
+        auto const values = stored_positions(world);
+        REQUIRE(std::is_sorted(values.begin(), values.end()));
+        check_consistent();
+    }
+
+    SECTION("Budgeted compaction")
+    {
+        struct count_chunks : chunk_system<position, const velocity>
+        {
+            mutable int chunks = 0;
+            mutable size_t count = 0;
+            void update(duration_type, std::span<position> p, std::span<const velocity>) const override
+            {
+                ++chunks;
+                count += p.size();
+            }
+        } system;
+        system_list list;
+        list.add(system);
+        world.update(0.0, list);
+        auto const chunks_before = system.chunks;
+        auto const count = system.count;
+
+        while (!world.compact(std::chrono::microseconds(1)))
+            ;
+        system.chunks = 0;
+        system.count = 0;
+        world.update(0.0, list);
+        REQUIRE(system.count == count);
+        REQUIRE(system.chunks < chunks_before);
+        check_consistent();
+    }
+}
+
+TEST_CASE("ECS hierarchy")
+{
+    struct transform : component<transform>
+    {
+        float local = 1;
+        float world = 0;
+    };
+    auto const accumulate = [](transform& t, const transform* parent) { t.world = t.local + (parent ? parent->world : 0); };
+
+    ecs world;
+    std::mt19937 rng(5);
+    std::vector<entity> entities;
+    for (int i = 0; i < 1000; ++i)
+    {
+        entities.push_back(world.create_entity(transform{}));
+        if (i > 0)
+            REQUIRE(world.set_parent(entities.back(), entities[rng() % i]));
+    }
+
+    // Every world value is the number of entities on the path to the root.
+    auto const check = [&] {
+        for (auto& e : entities)
+        {
+            if (!e)
+                continue;
+            auto const parent = world.parent_of(e);
+            REQUIRE(e.get<transform>()->world == 1 + (parent ? world.get_component<transform>(parent)->world : 0));
+        }
+    };
+
+    SECTION("Propagate")
+    {
+        world.propagate<transform>(accumulate);
+        check();
+        world.propagate<transform>(std::execution::par, accumulate);
+        check();
+    }
+
+    SECTION("Parallel propagation invalidates the sorted range")
+    {
+        auto const by_world = [](const transform& a, const transform& b) { return a.world < b.world; };
+        world.propagate<transform>(accumulate);
+        REQUIRE(world.sort_by<transform>(by_world));
+        world.propagate<transform>(
+            std::execution::par, [](transform& t, const transform* parent) { t.world = (parent ? parent->world : 0) - t.local; });
+        REQUIRE(world.sort_by<transform>(by_world));
+
+        struct collect : typed_system<const transform>
+        {
+            std::vector<float>* values;
+            void update(duration_type, const transform* t) const override { values->push_back(t->world); }
+        } system;
+        std::vector<float> values;
+        system.values = &values;
+        system_list list;
+        list.add(system);
+        world.update(0.0, list);
+        REQUIRE(values.size() == entities.size());
+        REQUIRE(values.front() < 0);
+        REQUIRE(std::is_sorted(values.begin(), values.end()));
+    }
+
+    SECTION("Reparent and delete")
+    {
+        for (int k = 0; k < 200; ++k)
+        {
+            auto const child = 1 + rng() % 999;
+            REQUIRE(world.set_parent(entities[child], entities[rng() % child]));
+        }
+        for (int k = 0; k < 100; ++k)
+        {
+            auto& e = entities[rng() % 1000];
+            if (e)
+                world.delete_entity(std::exchange(e, entity{}));
+        }
+        world.propagate<transform>(accumulate);
+        check();
+
+        REQUIRE(world.set_parent(entities[999] ? entities[999] : entities[998], null_entity));
+        world.propagate<transform>(accumulate);
+        check();
+    }
+
+    SECTION("Cycles are rejected")
+    {
+        auto const root = world.create_entity(transform{});
+        auto const child = world.create_entity(transform{});
+        auto const grandchild = world.create_entity(transform{});
+        REQUIRE(world.set_parent(child, root));
+        REQUIRE(world.set_parent(grandchild, child));
+
+        REQUIRE_FALSE(world.set_parent(root, grandchild));
+        REQUIRE_FALSE(world.set_parent(child, child));
+        REQUIRE(world.parent_of(root) == null_entity);
+        REQUIRE(world.parent_of(child) == static_cast<entity_handle>(root));
+
+        world.propagate<transform>(accumulate);
+        REQUIRE(world.get_component<transform>(grandchild)->world == 3);
+    }
+}
+
+TEST_CASE("ECS resources and shared components")
+{
+    struct material
+    {
+        std::string name;
+        bool operator==(const material&) const = default;
+    };
+
+    ecs world;
+
+    SECTION("Resources")
+    {
+        struct clock
+        {
+            double time = 0;
+        };
+        struct read_clock : typed_system<const position>
+        {
+            mutable double seen = -1;
+            void update(duration_type, const position*) const override { seen = resource<clock>()->time; }
+        } system;
+
+        REQUIRE(world.resource<clock>() == nullptr);
+        REQUIRE_FALSE(world.remove_resource<clock>());
+        world.emplace_resource<clock>().time = 1;
+        world.emplace_resource<clock>(clock{2});
+        REQUIRE(world.resource<clock>()->time == 2);
+        REQUIRE(std::as_const(world).resource<clock>()->time == 2);
+
+        world.create_entity(position{});
+        system_list list;
+        list.add(system);
+        world.update(0.0, list);
+        REQUIRE(system.seen == 2);
+
+        REQUIRE(world.remove_resource<clock>());
+        REQUIRE(world.resource<clock>() == nullptr);
+        REQUIRE_FALSE(world.remove_resource<clock>());
+    }
+
+    SECTION("Shared values are reference counted")
+    {
+        auto const entities = world.create_entities(6);
+        for (size_t i = 0; i < entities.size(); ++i)
+            world.set_shared(entities[i], material{i % 2 ? "stone" : "wood"});
+        REQUIRE(world.get_shared<material>(entities[0]) == world.get_shared<material>(entities[2]));
+        REQUIRE(world.get_shared<material>(entities[1])->name == "stone");
+        auto const stone = world.get_shared<material>(entities[1]);
+        auto const wood_slot = world.get_component<shared<material>>(entities[0])->slot;
+
+        auto const groups = [&] {
+            std::vector<std::pair<std::string, size_t>> result;
+            world.for_each_shared<material>([&](const material& m, std::span<const shared<material>> references) {
+                result.emplace_back(m.name, references.size());
+                for (auto& r : references)
+                    REQUIRE(world.get_shared<material>(r.entity)->name == m.name);
+            });
+            std::sort(result.begin(), result.end());
+            return result;
+        };
+        REQUIRE(groups() == std::vector<std::pair<std::string, size_t>>{{"stone", 3}, {"wood", 3}});
+
+        // Dropping the last references frees the slot, which the next new value reuses.
+        world.set_shared(entities[0], material{"stone"});
+        REQUIRE(world.remove_shared<material>(entities[2]));
+        world.delete_entity(entities[4]);
+        REQUIRE(groups() == std::vector<std::pair<std::string, size_t>>{{"stone", 4}});
+        REQUIRE_FALSE(world.remove_shared<material>(entities[2]));
+        REQUIRE(world.get_shared<material>(entities[2]) == nullptr);
+
+        world.set_shared(entities[2], material{"glass"});
+        REQUIRE(world.get_shared<material>(entities[1]) == stone);
+        REQUIRE(world.get_shared<material>(entities[2])->name == "glass");
+        REQUIRE(world.get_component<shared<material>>(entities[2])->slot == wood_slot);
+        REQUIRE(groups() == std::vector<std::pair<std::string, size_t>>{{"glass", 1}, {"stone", 4}});
+        REQUIRE(world.save_snapshot().error() == snapshot_error::not_serializable);
+    }
+}
+
+TEST_CASE("ECS events")
+{
+    struct collision
+    {
+        int first;
+        int second;
+    };
+
+    ecs world;
+    system_list systems;
+    auto& added_positions = world.events<added<position>>();
+    auto& removed_positions = world.events<removed<position>>();
+    auto& collisions = world.events<collision>();
+    event_stream<entity_handle>::reader early;
+    event_stream<entity_handle>::reader late;
+
+    auto const created = world.create_entities(10, position{});
+    auto moving = world.create_entity(velocity{});
+    moving.add(position{});
+
+    SECTION("Component events")
+    {
+        std::vector<entity_handle> seen;
+        REQUIRE(added_positions.read(early, [&](std::span<const entity_handle> handles) { seen.insert(seen.end(), handles.begin(), handles.end()); }) == 11);
+        REQUIRE(seen.back() == static_cast<entity_handle>(moving));
+        REQUIRE(added_positions.unread(early) == 0);
+        REQUIRE(added_positions.unread(late) == 11);
+
+        // Events stay readable for one more update.
+        world.update(0.0, systems);
+        world.delete_entity(created[0]);
+        moving.remove<position>();
+        REQUIRE(added_positions.read(early, [](auto) {}) == 0);
+        REQUIRE(added_positions.read(late, [](auto) {}) == 11);
+        REQUIRE(removed_positions.size() == 2);
+
+        world.update(0.0, systems);
+        world.update(0.0, systems);
+        REQUIRE(added_positions.empty());
+        REQUIRE(removed_positions.empty());
+        event_stream<entity_handle>::reader fresh;
+        REQUIRE(removed_positions.unread(fresh) == 0);
+    }
+
+    SECTION("User events")
+    {
+        event_stream<collision>::reader first;
+        event_stream<collision>::reader second;
+        collisions.send(collision{1, 2});
+        collision const batch[] = {{3, 4}, {5, 6}};
+        collisions.send(batch);
+
+        int sum = 0;
+        REQUIRE(collisions.read(first, [&](std::span<const collision> events) {
+            for (auto& c : events)
+                sum += c.first + c.second;
+        }) == 3);
+        REQUIRE(sum == 21);
+
+        world.update(0.0, systems);
+        collisions.send(collision{7, 8});
+        REQUIRE(collisions.unread(first) == 1);
+        REQUIRE(collisions.unread(second) == 4);
+
+        world.update(0.0, systems);
+        REQUIRE(collisions.unread(second) == 1);
+        REQUIRE(collisions.read(second, [](auto) {}) == 1);
+    }
+
+    SECTION("Loaded snapshots send added events")
+    {
+        ecs loaded;
+        auto& loaded_positions = loaded.events<added<position>>();
+        REQUIRE(loaded.load_snapshot(*world.save_snapshot()));
+        REQUIRE(loaded_positions.size() == 11);
+    }
+}
+
+TEST_CASE("ECS world views")
+{
+    struct camera
+    {
+        int zoom = 7;
+    };
+
+    ecs world;
+    world.emplace_resource<camera>();
+    auto const entities = world.create_entities(1000, make_position(1), velocity{});
+    auto const view = world.view();
+
+    SECTION("Parallel readers and writers")
+    {
+        std::atomic_int sum = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&, t] {
+                if (t == 0)
+                {
+                    auto writer = view.write<velocity>();
+                    for (auto& e : entities)
+                        writer.get(e)->x += 1;
+                    return;
+                }
+                auto const reader = view.read<position>();
+                float s = 0;
+                for (auto& p : reader.components())
+                    s += p.x;
+                for (auto& e : entities)
+                    s += reader.get(e)->x;
+                sum += int(s) + view.resource<camera>()->zoom;
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        REQUIRE(sum == 3 * (2000 + 7));
+        REQUIRE(entities[3].get<velocity>()->x == 2);
+    }
+
+    SECTION("Locks outlive later views")
+    {
+        auto const reader = view.read<position>();
+        auto const later = world.view();
+        REQUIRE(later.read<position>().get(entities[0])->x == 1);
+        REQUIRE(reader.get(entities[0])->x == 1);
+        REQUIRE(view.entity_count() == later.entity_count());
+    }
+
+    SECTION("Empty readers and writers")
+    {
+        component_reader<position> reader;
+        component_writer<velocity> writer;
+        REQUIRE(reader.components().empty());
+        REQUIRE(reader.get(entities[0]) == nullptr);
+        REQUIRE_FALSE(writer.contains(entities[0]));
+        REQUIRE(writer.get(entities[0]) == nullptr);
+    }
+}
@@ -0,0 +1,323 @@
+#include "catch_amalgamated.hpp"
+#include <rnu/obj.hpp>
+#include <rnu/thread_pool.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+
+using namespace rnu;
+
+namespace
+{
+    constexpr std::string_view sample_obj =
+        "mtllib test.mtl\r\n"
+        "v 1 2 3\r\n"
+        "v +4 5.5 -6e1\n"
+        "v 7 8 9\n"
+        "vt 0.5 1\n"
+        "vn 0 0 1\n"
+        "o first\n"
+        "usemtl red\n"
+        "f 1/1/1 2/1/1 3/1/1\n"
+        "f -1//-1 -2//-1 -3//-1\n"
+        "o second\n"
+        "v 10 11 12\n"
+        "v 13 14 15\n"
+        "v 16 17 18\n"
+        "g side\n"
+        "usemtl blue\n"
+        "f 4 5 6 4\n";
+
+    // Directory with the material library of the sample files.
+    std::filesystem::path test_directory()
+    {
+        auto const directory = std::filesystem::temp_directory_path() / "rnu_test_obj";
+        std::filesystem::create_directories(directory);
+        std::ofstream(directory / "test.mtl") << "newmtl red\nKd 1 0 0\nnewmtl blue\nKd 0 0 1\n";
+        return directory;
+    }
+
+    // The original stream based parser, without material libraries. Needs an "o" before the first face.
+    std::vector<object_t> reference_load_obj(std::string const& text)
+    {
+        std::vector<object_t> result;
+        size_t pos_index_offset = 1;
+        size_t tex_index_offset = 1;
+        size_t nor_index_offset = 1;
+        object_t intermediate_obj;
+        std::unordered_map<std::string, std::shared_ptr<material_t>> mtllib;
+        auto current_material = std::make_shared<material_t>();
+        current_material->name = "Default";
+
+        std::stringstream stream(text);
+        for (std::string line; std::getline(stream, line);)
+        {
+            std::stringstream line_stream(line);
+            while ((line_stream.peek() == ' ' || line_stream.peek() == '\t') && !line_stream.eof())
+                line_stream.ignore();
+            std::string identifier;
+            line_stream >> identifier;
+
+            if (identifier == "usemtl")
+            {
+                std::string name;
+                line_stream >> name;
+                current_material = mtllib[name];
+                if (result.back().groups.empty() || !result.back().groups.back().faces.empty())
+                    result.back().groups.emplace_back().name = name;
+                result.back().groups.back().material = current_material;
+            }
+            else if (identifier == "o")
+            {
+                if (!result.empty())
+                {
+                    pos_index_offset += result.back().positions.size();
+                    tex_index_offset += result.back().texcoords.size();
+                    nor_index_offset += result.back().normals.size();
+                }
+                line_stream >> result.emplace_back().name;
+            }
+            else if (identifier == "g")
+            {
+                std::string name;
+                line_stream >> name;
+                auto& next = result.back().groups.emplace_back();
+                next.name = std::move(name);
+                next.material = current_material;
+            }
+            else if (identifier == "v")
+            {
+                auto& arr = intermediate_obj.positions.emplace_back();
+                line_stream >> arr[0] >> arr[1] >> arr[2];
+            }
+            else if (identifier == "vn")
+            {
+                auto& arr = intermediate_obj.normals.emplace_back();
+                line_stream >> arr[0] >> arr[1] >> arr[2];
+            }
+            else if (identifier == "vt")
+            {
+                auto& arr = intermediate_obj.texcoords.emplace_back();
+                line_stream >> arr[0] >> arr[1];
+            }
+            else if (identifier == "f")
+            {
+                auto& object = result.back();
+                if (object.groups.empty())
+                    object.groups.emplace_back().name = "Default";
+                object.positions.insert(object.positions.end(), intermediate_obj.positions.begin(), intermediate_obj.positions.end());
+                object.normals.insert(object.normals.end(), intermediate_obj.normals.begin(), intermediate_obj.normals.end());
+                object.texcoords.insert(object.texcoords.end(), intermediate_obj.texcoords.begin(), intermediate_obj.texcoords.end());
+                intermediate_obj = {};
+
+                auto& face = object.groups.back().faces.emplace_back();
+                line_stream.ignore();
+                for (std::string vertex; std::getline(line_stream, vertex, ' ');)
+                {
+                    if (std::ranges::all_of(vertex, [](char c) { return std::isspace(c); }))
+                        continue;
+                    char* ptr = vertex.data();
+                    auto const p = std::strtol(ptr, &ptr, 10);
+                    ++ptr;
+                    auto const t = std::strtol(ptr, &ptr, 10);
+                    ++ptr;
+                    auto const n = std::strtol(ptr, &ptr, 10);
+
+                    auto const resolve = [](long index, size_t count, size_t offset) {
+                        if (index < 0)
+                            return static_cast<unsigned>(count + index);
+                        return index != 0 ? static_cast<unsigned>(index - offset) : 0u;
+                    };
+                    auto& v = face.vertices.emplace_back();
+                    v[0] = resolve(p, object.positions.size(), pos_index_offset);
+                    v[1] = resolve(t, object.texcoords.size(), tex_index_offset);
+                    v[2] = resolve(n, object.normals.size(), nor_index_offset);
+                }
+            }
+        }
+
+        for (auto& o : result)
+        {
+            if (o.texcoords.empty())
+                o.texcoords.push_back({ 0, 0 });
+            if (o.normals.empty())
+                o.normals.push_back({ 0, 1, 0 });
+        }
+        return result;
+    }
+
+    // Random objects with interleaved vertex data, groups, materials and faces with absolute and relative indices.
+    std::string generate_obj(unsigned seed, size_t size, bool crlf)
+    {
+        std::mt19937 rng(seed);
+        auto const random = [&](int min, int max) { return std::uniform_int_distribution<int>(min, max)(rng); };
+        std::uniform_real_distribution<float> coordinate(-100, 100);
+
+        std::string text;
+        char buffer[128];
+        auto const line = [&](int length) {
+            text.append(buffer, static_cast<size_t>(length));
+            text += crlf ? "\r\n" : "\n";
+        };
+
+        // Attributes of all previous objects, absolute indices count across them.
+        int base = 0;
+        for (int object = 0; text.size() < size; ++object)
+        {
+            line(std::snprintf(buffer, sizeof(buffer), "o obj%d", object));
+            auto const vertex_count = random(3, 500);
+            auto const interleaved = random(0, 2) == 0;
+            int count = 0;
+            for (int group = 0, groups = random(1, 3); group < groups; ++group)
+            {
+                if (random(0, 1))
+                    line(std::snprintf(buffer, sizeof(buffer), "g group%d", group));
+                if (random(0, 1))
+                    line(std::snprintf(buffer, sizeof(buffer), "usemtl %s", random(0, 1) ? "red" : "blue"));
+                if (group == 0 || interleaved)
+                {
+                    for (int i = 0; i < vertex_count; ++i)
+                        line(std::snprintf(buffer, sizeof(buffer), "v %f %g %.3e", coordinate(rng), coordinate(rng), coordinate(rng)));
+                    for (int i = 0; i < vertex_count; ++i)
+                        line(std::snprintf(buffer, sizeof(buffer), "vt %f %f", coordinate(rng), coordinate(rng)));
+                    for (int i = 0; i < vertex_count; ++i)
+                        line(std::snprintf(buffer, sizeof(buffer), "vn %f %f %f", coordinate(rng), coordinate(rng), coordinate(rng)));
+                    count += vertex_count;
+                }
+                for (int face = 0, faces = random(1, 300); face < faces; ++face)
+                {
+                    int length = std::snprintf(buffer, sizeof(buffer), "f");
+                    for (int v = 0, vertices = random(3, 5); v < vertices; ++v)
+                    {
+                        auto const index = random(1, count);
+                        switch (random(0, 2))
+                        {
+                        case 0:
+                            length += std::snprintf(buffer + length, sizeof(buffer) - length, " %d/%d/%d", base + index, base + index, base + index);
+                            break;
+                        case 1:
+                            length += std::snprintf(buffer + length, sizeof(buffer) - length, " %d//%d", base + index, -index);
+                            break;
+                        default:
+                            length += std::snprintf(buffer + length, sizeof(buffer) - length, " %d/%d/%d", -index, -index, -index);
+                            break;
+                        }
+                    }
+                    line(length);
+                }
+            }
+            base += count;
+        }
+        return text;
+    }
+
+    bool same_objects(std::vector<object_t> const& a, std::vector<object_t> const& b)
+    {
+        auto const same_groups = [](vertex_group_t const& x, vertex_group_t const& y) {
+            auto const same_faces = [](face_t const& f, face_t const& g) { return f.vertices == g.vertices; };
+            auto const same_material = x.material && y.material ? x.material->name == y.material->name : x.material == y.material;
+            return x.name == y.name && same_material && std::ranges::equal(x.faces, y.faces, same_faces);
+        };
+        auto const same_object = [&](object_t const& x, object_t const& y) {
+            return x.name == y.name && x.positions == y.positions && x.texcoords == y.texcoords && x.normals == y.normals &&
+                std::ranges::equal(x.groups, y.groups, same_groups);
+        };
+        return std::ranges::equal(a, b, same_object);
+    }
+
+    bool equal(obj_vec3 const& v, float x, float y, float z)
+    {
+        return v[0] == x && v[1] == y && v[2] == z;
+    }
+
+    bool equal(obj_face const& f, unsigned p, unsigned t, unsigned n)
+    {
+        return f[0] == p && f[1] == t && f[2] == n;
+    }
+}
+
+TEST_CASE("OBJ parsing")
+{
+    auto const directory = test_directory();
+
+    SECTION("Objects, groups and materials")
+    {
+        auto const objects = load_obj(std::span(sample_obj.data(), sample_obj.size()), directory);
+        REQUIRE(objects);
+        REQUIRE(objects->size() == 2);
+
+        auto const& first = (*objects)[0];
+        REQUIRE(first.name == "first");
+        REQUIRE(first.positions.size() == 3);
+        REQUIRE(equal(first.positions[1], 4, 5.5f, -60));
+        REQUIRE(first.texcoords.size() == 1);
+        REQUIRE(first.normals.size() == 1);
+        REQUIRE(first.groups.size() == 1);
+        REQUIRE(first.groups[0].name == "red");
+        REQUIRE(first.groups[0].material->diffuse[0] == 1);
+        REQUIRE(first.groups[0].faces.size() == 2);
+        REQUIRE(equal(first.groups[0].faces[0].vertices[2], 2, 0, 0));
+        // Negative indices count back from the end, missing ones are 0.
+        REQUIRE(equal(first.groups[0].faces[1].vertices[0], 2, 0, 0));
+        REQUIRE(equal(first.groups[0].faces[1].vertices[2], 0, 0, 0));
+
+        auto const& second = (*objects)[1];
+        REQUIRE(second.name == "second");
+        REQUIRE(equal(second.positions[0], 10, 11, 12));
+        // Default attributes for objects without any.
+        REQUIRE(second.texcoords.size() == 1);
+        REQUIRE(second.normals.size() == 1);
+        REQUIRE(second.groups.size() == 1);
+        REQUIRE(second.groups[0].name == "side");
+        REQUIRE(second.groups[0].material->diffuse[2] == 1);
+        // Indices count from 1 across all objects.
+        auto const& quad = second.groups[0].faces[0].vertices;
+        REQUIRE(quad.size() == 4);
+        REQUIRE(equal(quad[0], 0, 0, 0));
+        REQUIRE(equal(quad[2], 2, 0, 0));
+        REQUIRE(triangulate(second)[0].indices.size() == 6);
+    }
+
+    SECTION("Files")
+    {
+        auto const file = directory / "sample.obj";
+        std::ofstream(file, std::ios::binary) << sample_obj;
+        auto const objects = load_obj(file);
+        REQUIRE(objects);
+        REQUIRE(objects->size() == 2);
+
+        REQUIRE(load_obj(directory / "missing.obj").error() == loading_error::file_not_found);
+        // Exists, but cannot be mapped.
+        REQUIRE(load_obj(directory).error() == loading_error::read_failed);
+
+        auto const empty = directory / "empty.obj";
+        std::ofstream(empty).close();
+        REQUIRE(load_obj(empty));
+        REQUIRE(load_obj(empty)->empty());
+    }
+}
+
+TEST_CASE("OBJ parsers agree")
+{
+    thread_pool pool(4);
+    for (auto const crlf : { false, true })
+    {
+        // Several chunks for the parallel parser.
+        auto const text = generate_obj(crlf ? 2 : 1, 3 << 20, crlf);
+        auto const reference = reference_load_obj(text);
+        auto const sequential = load_obj(std::span(text.data(), text.size()), {});
+        auto const parallel = load_obj(std::span(text.data(), text.size()), {}, pool);
+        REQUIRE(sequential);
+        REQUIRE(parallel);
+        REQUIRE(reference.size() > 10);
+        REQUIRE(same_objects(*sequential, reference));
+        REQUIRE(same_objects(*parallel, reference));
+    }
+}
@@ -0,0 +1,919 @@
+#include "catch_amalgamated.hpp"
+#include <rnu/node_pool.hpp>
+#include <rnu/parallel.hpp>
+#include <rnu/task.hpp>
+#include <rnu/task_graph.hpp>
+#include <rnu/thread_pool.hpp>
+#include <rnu/thread_pool_profiler.hpp>
+#include <rnu/unique_function.hpp>
+#include <rnu/work_stealing_deque.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <latch>
+#include <memory>
+#include <optional>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+using namespace rnu;
+
+namespace
+{
+    task<int> doubled(thread_pool& pool, int value)
+    {
+        co_await pool.schedule();
+        co_return value * 2;
+    }
+
+    task<int> failing(thread_pool& pool)
+    {
+        co_await pool.schedule();
+        throw std::runtime_error("failed");
+    }
+
+    task<std::string> pipeline(thread_pool& pool)
+    {
+        co_await pool.schedule();
+        auto const on_worker = pool.current_worker() >= 0;
+        auto const a = co_await doubled(pool, 5);
+        auto const b = co_await pool.submit([] { return 7; });
+        auto const [x, y, z] = co_await when_all(doubled(pool, 1), doubled(pool, 2), doubled(pool, 3));
+        std::vector<task<int>> many;
+        for (int i = 0; i < 50; ++i)
+            many.push_back(doubled(pool, i));
+        auto const values = co_await when_all(std::move(many));
+        auto const sum = std::accumulate(values.begin(), values.end(), 0);
+        try
+        {
+            co_await failing(pool);
+            co_return "failure not propagated";
+        }
+        catch (std::runtime_error const&)
+        {
+        }
+        co_return on_worker ? std::to_string(a + b + x + y + z + sum) : "not on a worker";
+    }
+
+    // Counts live instances, so tests can check that every copy and moved-from callable is destroyed.
+    struct counted
+    {
+        explicit counted(std::atomic_int& live) : live(&live) { ++live; }
+        counted(counted const& other) : live(other.live) { ++*live; }
+        counted(counted&& other) noexcept : live(other.live) { ++*live; }
+        ~counted() { --*live; }
+
+        std::atomic_int* live;
+    };
+
+    task<long> recurse(int depth)
+    {
+        if (depth == 0)
+            co_return 0;
+        co_return 1 + co_await recurse(depth - 1);
+    }
+
+    task<int> await_many(thread_pool& pool, int count)
+    {
+        int sum = 0;
+        for (int i = 0; i < count; ++i)
+            sum += co_await pool.submit([i] { return i; });
+        co_return sum;
+    }
+}
+
+TEST_CASE("Work stealing deque")
+{
+    work_stealing_deque<int*> deque(4);
+    std::vector<int> values(10000);
+
+    SECTION("Owner pops in LIFO order and grows")
+    {
+        for (auto& v : values)
+            deque.push(&v);
+        for (auto it = values.rbegin(); it != values.rend(); ++it)
+            REQUIRE(deque.pop() == &*it);
+        REQUIRE(deque.pop() == nullptr);
+        REQUIRE(deque.steal() == nullptr);
+    }
+
+    SECTION("Every element is taken exactly once")
+    {
+        std::atomic_bool done = false;
+        std::vector<std::thread> thieves;
+        for (int t = 0; t < 3; ++t)
+        {
+            thieves.emplace_back([&] {
+                while (!done)
+                {
+                    if (auto* v = deque.steal())
+                        ++*v;
+                }
+                while (auto* v = deque.steal())
+                    ++*v;
+            });
+        }
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            deque.push(&values[i]);
+            if (i % 3 == 0)
+            {
+                if (auto* v = deque.pop())
+                    ++*v;
+            }
+        }
+        while (auto* v = deque.pop())
+            ++*v;
+        done = true;
+        for (auto& thief : thieves)
+            thief.join();
+        for (auto v : values)
+            REQUIRE(v == 1);
+    }
+}
+
+TEST_CASE("Thread pool modes")
+{
+    for (auto const mode : {thread_pool_mode::shared_queue, thread_pool_mode::work_stealing})
+    {
+        thread_pool pool(4, mode);
+        std::atomic_int sum = 0;
+        std::atomic_int outside_workers = 0;
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 500; ++i)
+        {
+            futures.push_back(pool.run_async<void>([&] {
+                if (pool.current_worker() < 0)
+                    ++outside_workers;
+                for (int j = 0; j < 10; ++j)
+                    pool.run_detached([&] { ++sum; });
+                ++sum;
+            }));
+        }
+        for (auto& f : futures)
+            f.get();
+        while (sum < 500 * 11)
+            std::this_thread::yield();
+        REQUIRE(outside_workers == 0);
+        REQUIRE(pool.run_async<int>([] { return 42; }).get() == 42);
+        REQUIRE(pool.current_worker() == -1);
+    }
+
+    basic_thread_pool<int> pool([](unsigned index) { return int(index); }, 3, thread_pool_mode::work_stealing);
+    REQUIRE(pool.run_async<int>([](int& index) { return index + 100; }).get() >= 100);
+}
+
+TEST_CASE("Thread pool wake-ups")
+{
+    // Job a waits for job b, pushed right after it. Workers that spin while both are pushed must not swallow the
+    // wake-up for b, or b only runs once a waits no longer.
+    for (auto const mode : {thread_pool_mode::shared_queue, thread_pool_mode::work_stealing})
+    {
+        thread_pool pool(4, mode);
+        int timeouts = 0;
+        for (int i = 0; i < 200; ++i)
+        {
+            // Let all workers fall asleep, then have a single one spinning after it ran a job.
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            std::atomic_bool ran = false;
+            pool.run_detached([&] { ran = true; });
+            while (!ran)
+                std::this_thread::yield();
+
+            std::atomic_bool b_done = false;
+            auto a = pool.run_async<bool>([&] {
+                auto const deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+                while (!b_done)
+                {
+                    if (std::chrono::steady_clock::now() > deadline)
+                        return false;
+                    std::this_thread::yield();
+                }
+                return true;
+            });
+            pool.run_detached([&] { b_done = true; });
+            if (!a.get())
+                ++timeouts;
+            while (!b_done)
+                std::this_thread::yield();
+        }
+        CHECK(timeouts == 0);
+    }
+}
+
+TEST_CASE("Thread pool options")
+{
+    SECTION("Names and affinity")
+    {
+        // The second cpu does not exist and is ignored.
+        thread_pool pool(thread_pool_options{ .concurrency = 2, .mode = thread_pool_mode::work_stealing,
+            .name = "a long worker name", .cpus = { 0, 100000 } });
+        auto const worker = pool.submit([&] { return pool.current_worker(); }).get();
+        REQUIRE(worker >= 0);
+        REQUIRE(worker < 2);
+#ifdef __linux__
+        auto const name = pool.submit([] {
+            char buffer[16] = {};
+            pthread_getname_np(pthread_self(), buffer, sizeof(buffer));
+            return std::string(buffer);
+        }).get();
+        REQUIRE(name == "a long worker n");
+#endif
+    }
+
+    SECTION("High priority jobs run before queued normal ones")
+    {
+        auto const mode = GENERATE(thread_pool_mode::shared_queue, thread_pool_mode::work_stealing);
+        thread_pool pool(1, mode);
+        // Only the single worker writes to it while it runs the jobs.
+        std::vector<int> order;
+        std::latch release(1);
+        std::vector<job_future<void>> done;
+        done.push_back(pool.submit([&] { release.wait(); }));
+        for (int i = 0; i < 4; ++i)
+        {
+            done.push_back(pool.submit([&order, i] { order.push_back(i); }));
+            done.push_back(pool.submit([&order, i] { order.push_back(10 + i); }, job_priority::high));
+        }
+        release.count_down();
+        for (auto& future : done)
+            future.get();
+        REQUIRE(order == std::vector<int>{ 10, 11, 12, 13, 0, 1, 2, 3 });
+
+        // Normal jobs pushed by a worker go to its own deque in work stealing mode, high priority ones do not.
+        order.clear();
+        std::latch finished(8);
+        pool.run_detached([&] {
+            for (int i = 0; i < 4; ++i)
+            {
+                pool.run_detached([&, i] { order.push_back(i); finished.count_down(); });
+                pool.run_detached([&, i] { order.push_back(10 + i); finished.count_down(); }, job_priority::high);
+            }
+        });
+        finished.wait();
+        REQUIRE(std::vector<int>(order.begin(), order.begin() + 4) == std::vector<int>{ 10, 11, 12, 13 });
+        REQUIRE(std::is_permutation(order.begin() + 4, order.end(), std::begin({ 0, 1, 2, 3 })));
+    }
+}
+
+TEST_CASE("Parallel algorithms")
+{
+    for (auto const mode : {thread_pool_mode::shared_queue, thread_pool_mode::work_stealing})
+    {
+        thread_pool pool(4, mode);
+
+        std::vector<int> values(100000);
+        parallel_for(pool, 0, int(values.size()), [&](int i) { values[i] = i; });
+        std::vector<int> indices(values.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        REQUIRE(values == indices);
+        parallel_for(pool, values, [](int& v) { v *= 2; }, 1000);
+        REQUIRE(parallel_reduce(pool, size_t(0), values.size(), 0ll, [&](size_t i) { return (long long)values[i]; }, std::plus<>{}) ==
+            std::accumulate(values.begin(), values.end(), 0ll));
+
+        // The reduction keeps the order of the range.
+        auto const letters = parallel_reduce(
+            pool, 0, 2000, std::string(), [](int i) { return std::string(1, char('a' + i % 26)); },
+            [](std::string a, std::string const& b) { return a + b; }, 7);
+        REQUIRE(letters.size() == 2000);
+        for (int i = 0; i < 2000; ++i)
+            REQUIRE(letters[i] == 'a' + i % 26);
+
+        std::mt19937 rng(1);
+        std::vector<float> floats(200000);
+        for (auto& f : floats)
+            f = float(rng() % 1000);
+        auto expected = floats;
+        std::sort(expected.begin(), expected.end());
+        parallel_sort(pool, floats);
+        REQUIRE(floats == expected);
+        parallel_sort(pool, floats.begin(), floats.end(), std::greater<>{}, 100);
+        REQUIRE(std::is_sorted(floats.begin(), floats.end(), std::greater<>{}));
+
+        // Nested loops help instead of blocking their workers.
+        std::atomic_int count = 0;
+        parallel_for(pool, 0, 64, [&](int) { parallel_for(pool, 0, 100, [&](int) { ++count; }); });
+        REQUIRE(count == 6400);
+
+        REQUIRE_THROWS_AS(parallel_for(pool, 0, 1000, [](int i) {
+            if (i == 777)
+                throw std::runtime_error("failed");
+        }, 10), std::runtime_error);
+    }
+
+    basic_thread_pool<int> pool([](unsigned index) { return int(index); }, 3);
+    std::atomic_int count = 0;
+    parallel_for(pool, 0, 1000, [&](int) { ++count; });
+    REQUIRE(count == 1000);
+}
+
+TEST_CASE("Parallel sort with adversarial input")
+{
+    // McIlroy's adversary decides comparisons lazily so that every pivot ends up next to the minimum. The comparisons
+    // have to happen in a fixed order, so the pool has no workers and the calling thread runs every partition.
+    size_t const n = 5000;
+    int const gas = int(n);
+    std::vector<int> values(n, gas);
+    int solid = 0;
+    int candidate = -1;
+    char const* stack_base = nullptr;
+    size_t stack_used = 0;
+    auto const less = [&](int a, int b) {
+        char marker;
+        stack_used = std::max<size_t>(stack_used, size_t(stack_base - &marker));
+        if (values[a] == gas && values[b] == gas)
+            values[a == candidate ? a : b] = solid++;
+        if (values[a] == gas)
+            candidate = a;
+        else if (values[b] == gas)
+            candidate = b;
+        return values[a] < values[b];
+    };
+
+    std::vector<int> items(n);
+    std::iota(items.begin(), items.end(), 0);
+    thread_pool pool(0);
+    char base;
+    stack_base = &base;
+    parallel_sort(pool, items, less, 16);
+    REQUIRE(std::is_sorted(items.begin(), items.end(), [&](int a, int b) { return values[a] < values[b]; }));
+    // Nesting one frame per partition would take megabytes here.
+    REQUIRE(stack_used < 256 * 1024);
+}
+
+TEST_CASE("Unique function")
+{
+    std::atomic_int live = 0;
+
+    SECTION("Small callables")
+    {
+        {
+            unique_function<int(int)> fun = [c = counted(live)](int x) { return x + 1; };
+            REQUIRE(fun(1) == 2);
+            auto moved = std::move(fun);
+            REQUIRE_FALSE(fun);
+            REQUIRE(moved(2) == 3);
+            REQUIRE(live == 1);
+            fun = std::move(moved);
+            REQUIRE(fun(3) == 4);
+            REQUIRE(live == 1);
+        }
+        REQUIRE(live == 0);
+    }
+
+    SECTION("Callables larger than the inline buffer")
+    {
+        std::array<char, unique_function<int()>::inline_size + 16> bytes{};
+        bytes.back() = 42;
+        {
+            unique_function<int()> fun = [bytes, c = counted(live)] { return int(bytes.back()); };
+            unique_function<int()> other = std::move(fun);
+            REQUIRE(other() == 42);
+            REQUIRE(live == 1);
+            other = nullptr;
+            REQUIRE_FALSE(other);
+            REQUIRE(live == 0);
+        }
+        REQUIRE(live == 0);
+    }
+
+    SECTION("Move-only callables and arguments")
+    {
+        unique_function<int(std::unique_ptr<int>)> fun = [offset = std::make_unique<int>(5)](std::unique_ptr<int> value) {
+            return *value + *offset;
+        };
+        auto moved = std::move(fun);
+        REQUIRE(moved(std::make_unique<int>(2)) == 7);
+    }
+
+    SECTION("Callables that may throw on move are not moved")
+    {
+        struct throwing_move
+        {
+            throwing_move() = default;
+            throwing_move(throwing_move const&) = default;
+            throwing_move(throwing_move&& other) noexcept(false) : moves(other.moves) { ++*moves; }
+            int operator()() const { return 1; }
+            std::shared_ptr<int> moves = std::make_shared<int>(0);
+        };
+        throwing_move callable;
+        auto const moves = callable.moves;
+        unique_function<int()> fun = std::move(callable);
+        auto const stored = *moves;
+        auto moved = std::move(fun);
+        auto again = std::move(moved);
+        REQUIRE(again() == 1);
+        REQUIRE(*moves == stored);
+    }
+}
+
+TEST_CASE("Node pool")
+{
+    struct alignas(64) aligned_node
+    {
+        int value;
+        aligned_node(int v) : value(v)
+        {
+            if (v < 0)
+                throw std::invalid_argument("negative");
+        }
+    };
+    using pool = node_pool<aligned_node>;
+
+    SECTION("Freed nodes are reused")
+    {
+        auto* const first = pool::create(1);
+        pool::destroy(first);
+        auto* const second = pool::create(2);
+        REQUIRE(second == first);
+        REQUIRE(second->value == 2);
+        pool::destroy(second);
+
+        REQUIRE_THROWS_AS(pool::create(-1), std::invalid_argument);
+        auto* const third = pool::create(3);
+        REQUIRE(third == first);
+        pool::destroy(third);
+    }
+
+    SECTION("Live nodes are distinct and aligned")
+    {
+        std::vector<aligned_node*> nodes;
+        for (int i = 0; i < 1000; ++i)
+            nodes.push_back(pool::create(i));
+        for (int i = 0; i < 1000; ++i)
+        {
+            REQUIRE(nodes[i]->value == i);
+            REQUIRE(reinterpret_cast<uintptr_t>(nodes[i]) % 64 == 0);
+        }
+        std::sort(nodes.begin(), nodes.end());
+        REQUIRE(std::adjacent_find(nodes.begin(), nodes.end()) == nodes.end());
+
+        // Nodes freed on another thread travel back through the shared list.
+        std::thread([&] {
+            for (auto* node : nodes)
+                pool::destroy(node);
+        }).join();
+        std::vector<aligned_node*> again;
+        for (int i = 0; i < 1000; ++i)
+            again.push_back(pool::create(i));
+        std::sort(again.begin(), again.end());
+        REQUIRE(std::adjacent_find(again.begin(), again.end()) == again.end());
+        auto const reused = std::count_if(again.begin(), again.end(), [&](aligned_node* node) { return std::binary_search(nodes.begin(), nodes.end(), node); });
+        REQUIRE(reused >= 900);
+        for (auto* node : again)
+            pool::destroy(node);
+    }
+
+    SECTION("Submitted jobs")
+    {
+        std::atomic_int live = 0;
+        std::array<char, unique_function<void()>::inline_size * 2> bytes{};
+        bytes[7] = 7;
+        {
+            thread_pool tp(2);
+            std::vector<job_future<int>> futures;
+            for (int i = 0; i < 200; ++i)
+            {
+                if (i % 2)
+                    futures.push_back(tp.submit([bytes, c = counted(live), i] { return i + bytes[7]; }));
+                else
+                    futures.push_back(tp.submit([p = std::make_unique<int>(i), c = counted(live)] { return *p + 7; }));
+            }
+            for (int i = 0; i < 200; ++i)
+                REQUIRE(futures[i].get() == i + 7);
+        }
+        REQUIRE(live == 0);
+    }
+}
+
+TEST_CASE("Continuations and task graphs")
+{
+    auto const mode = GENERATE(thread_pool_mode::shared_queue, thread_pool_mode::work_stealing);
+    thread_pool pool(3, mode);
+
+    SECTION("then")
+    {
+        auto chained = pool.submit([] { return 20; }).then(pool, [](int x) { return x + 1; }).then(pool, [](int x) { return std::to_string(x); });
+        REQUIRE(chained.get() == "21");
+        REQUIRE(pool.submit([] {}).then(pool, [] { return 3; }).get() == 3);
+
+        bool continued = false;
+        auto failed = pool.submit([]() -> int { throw std::runtime_error("failed"); }).then(pool, [&](int x) {
+            continued = true;
+            return x;
+        });
+        REQUIRE_THROWS_AS(failed.get(), std::runtime_error);
+        REQUIRE_FALSE(continued);
+
+        auto ready = pool.submit([] { return 1; });
+        ready.wait();
+        REQUIRE(std::move(ready).then(pool, [](int v) { return v * 2; }).get() == 2);
+    }
+
+    SECTION("Destroying the pool completes continuations of dropped jobs")
+    {
+        job_future<int> continued;
+        {
+            std::latch started(1);
+            std::latch release(1);
+            // Joined after the pool, so it can release the worker once the pool destructor stopped it.
+            std::jthread releaser;
+            thread_pool single(1, mode);
+            single.run_detached([&] {
+                // Queued on the worker in work stealing mode, where it stays since the pool stops before the worker
+                // takes another job. Dropping it queues the continuation after the worker queues were drained.
+                continued = single.submit([] { return 1; }).then(single, [](int x) { return x + 1; });
+                started.count_down();
+                release.wait();
+            });
+            started.wait();
+            releaser = std::jthread([&] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                release.count_down();
+            });
+        }
+        REQUIRE(continued.is_ready());
+    }
+
+    SECTION("when_all")
+    {
+        std::vector<job_future<int>> futures;
+        for (int i = 0; i < 100; ++i)
+            futures.push_back(pool.submit([i] { return i; }));
+        auto sum = when_all(std::move(futures)).then(pool, [](std::vector<job_future<int>> results) {
+            int s = 0;
+            for (auto& r : results)
+                s += r.get();
+            return s;
+        });
+        REQUIRE(sum.get() == 4950);
+
+        auto all = when_all(pool.submit([] { return 1; }), pool.submit([] {}), pool.submit([] { return std::string("a"); })).get();
+        REQUIRE(std::get<0>(all).get() == 1);
+        std::get<1>(all).get();
+        REQUIRE(std::get<2>(all).get() == "a");
+        REQUIRE(when_all(std::vector<job_future<int>>{}).get().empty());
+
+        std::vector<job_future<int>> with_invalid;
+        with_invalid.push_back(pool.submit([] { return 1; }));
+        with_invalid.emplace_back();
+        REQUIRE_THROWS_AS(when_all(std::move(with_invalid)), std::invalid_argument);
+        auto moved = pool.submit([] { return 1; });
+        auto taken = std::move(moved);
+        REQUIRE_THROWS_AS(when_all(std::move(taken), std::move(moved)), std::invalid_argument);
+    }
+
+    SECTION("when_any")
+    {
+        std::atomic_bool release = false;
+        auto any = when_any(pool.submit([&] {
+            while (!release)
+                std::this_thread::yield();
+            return 0;
+        }), pool.submit([] { return 1; })).get();
+        REQUIRE(any.index == 1);
+        release = true;
+        REQUIRE(std::get<0>(any.futures).get() == 0);
+
+        auto none = when_any(std::vector<job_future<int>>{}).get();
+        REQUIRE(none.index == none.npos);
+
+        REQUIRE_THROWS_AS(when_any(job_future<int>{}, pool.submit([] { return 1; })), std::invalid_argument);
+    }
+
+    SECTION("Task graphs")
+    {
+        for (int repeat = 0; repeat < 20; ++repeat)
+        {
+            task_graph graph;
+            std::atomic_int order[8]{};
+            std::atomic_int clock = 0;
+            std::vector<task_graph::task> tasks;
+            for (int i = 0; i < 8; ++i)
+                tasks.push_back(graph.emplace([&, i] { order[i] = ++clock; }));
+            graph.precede(tasks[0], tasks[1]);
+            graph.precede(tasks[0], tasks[2]);
+            graph.precede(tasks[1], tasks[3]);
+            graph.precede(tasks[2], tasks[3]);
+            graph.precede(tasks[3], tasks[4]);
+            graph.precede(tasks[3], tasks[5]);
+            graph.precede(tasks[3], tasks[6]);
+            graph.precede(tasks[5], tasks[7]);
+            graph.precede(tasks[6], tasks[7]);
+            graph.run(pool).get();
+            REQUIRE(order[0] < order[1]);
+            REQUIRE(order[0] < order[2]);
+            REQUIRE(order[1] < order[3]);
+            REQUIRE(order[2] < order[3]);
+            REQUIRE(order[3] < order[4]);
+            REQUIRE(order[5] < order[7]);
+            REQUIRE(order[6] < order[7]);
+            // Graphs can run again.
+            graph.run(pool).get();
+            REQUIRE(clock == 16);
+        }
+
+        task_graph graph;
+        int runs = 0;
+        auto const failing = graph.emplace([] { throw std::logic_error("failed"); });
+        auto const dependent = graph.emplace([&] { ++runs; });
+        graph.precede(failing, dependent);
+        REQUIRE_THROWS_AS(graph.run(pool).get(), std::logic_error);
+        REQUIRE(runs == 0);
+        graph.precede(dependent, failing);
+        REQUIRE_THROWS_AS((void)graph.run(pool), std::invalid_argument);
+
+        task_graph empty;
+        empty.run(pool).get();
+    }
+
+    SECTION("Thread data")
+    {
+        basic_thread_pool<int> data_pool([](unsigned) { return 3; }, 2, mode);
+        basic_task_graph<int> graph;
+        std::atomic_int sum = 0;
+        graph.precede(graph.emplace([&](int& d) { sum += d; }), graph.emplace([&](int& d) { sum += d; }));
+        graph.run(data_pool).get();
+        REQUIRE(sum == 6);
+        REQUIRE(data_pool.submit([](int& d) { return d; }).then(data_pool, [](int v) { return v + 1; }).get() == 4);
+    }
+}
+
+TEST_CASE("Coroutines")
+{
+    auto const mode = GENERATE(thread_pool_mode::shared_queue, thread_pool_mode::work_stealing);
+
+    SECTION("Tasks")
+    {
+        thread_pool pool(3, mode);
+        for (int i = 0; i < 10; ++i)
+            REQUIRE(start(pipeline(pool)).get() == std::to_string(10 + 7 + 12 + 2450));
+        REQUIRE(start(recurse(1000)).get() == 1000);
+        REQUIRE_THROWS_AS(start(failing(pool)).get(), std::runtime_error);
+        // Never started.
+        auto const unused = doubled(pool, 1);
+    }
+
+    SECTION("Registering continuations")
+    {
+        thread_pool pool(1, mode);
+        std::latch release(1);
+        auto blocked = pool.submit([&] { release.wait(); });
+        std::atomic_bool called = false;
+        REQUIRE(blocked.try_on_ready([&] { called = true; called.notify_one(); }));
+        release.count_down();
+        // Continuations run after the state is ready, so wait for the call itself.
+        called.wait(false);
+
+        // A ready job does not take the continuation, so an awaiting coroutine is not resumed inside of
+        // await_suspend.
+        called = false;
+        REQUIRE_FALSE(blocked.try_on_ready([&] { called = true; }));
+        REQUIRE_FALSE(called);
+
+        // Jobs often complete between await_ready and await_suspend here.
+        REQUIRE(start(await_many(pool, 2000)).get() == 1999 * 1000);
+    }
+
+    SECTION("Destroying the pool cancels scheduled coroutines")
+    {
+        job_future<int> result;
+        {
+            // Without workers the scheduled coroutine is still queued when the pool is destroyed.
+            thread_pool pool(0, mode);
+            result = start(doubled(pool, 1));
+            REQUIRE_FALSE(result.is_ready());
+        }
+        REQUIRE(result.is_ready());
+        REQUIRE_THROWS_AS(result.get(), job_cancelled);
+    }
+}
+
+TEST_CASE("Thread pool profiler")
+{
+    using clock = thread_pool_profiler::clock;
+    thread_pool_profiler profiler(2);
+    auto const start = clock::now();
+
+    SECTION("Recording")
+    {
+        profiler.record_job(0, start, start + std::chrono::milliseconds(1), start + std::chrono::milliseconds(5), std::chrono::milliseconds(3), true, 4);
+        profiler.record_idle(1, start, start + std::chrono::milliseconds(2));
+        profiler.record_failed_steals(1, 3);
+        auto const total = profiler.total();
+        REQUIRE(total.jobs_run == 1);
+        REQUIRE(total.jobs_stolen == 1);
+        REQUIRE(total.failed_steals == 3);
+        REQUIRE(total.max_queue_depth == 4);
+        // Nested time only counts for the nested jobs.
+        REQUIRE(total.busy == std::chrono::milliseconds(1));
+        REQUIRE(total.idle == std::chrono::milliseconds(2));
+        REQUIRE(total.queue_wait.max == std::chrono::milliseconds(1));
+        REQUIRE(total.run_time.max == std::chrono::milliseconds(4));
+    }
+
+    SECTION("Workers without a slot are ignored")
+    {
+        profiler.record_job(2, start, start, start, {}, false, 0);
+        profiler.record_idle(7, start, start);
+        profiler.record_failed_steals(2, 1);
+        auto const total = profiler.total();
+        REQUIRE(total.jobs_run == 0);
+        REQUIRE(total.failed_steals == 0);
+    }
+
+#ifdef RNU_THREAD_POOL_PROFILING
+    SECTION("Nested jobs are not counted twice")
+    {
+        auto const mode = GENERATE(thread_pool_mode::shared_queue, thread_pool_mode::work_stealing);
+        thread_pool pool(1, mode);
+        pool.set_profiler(&profiler);
+        pool.submit([&] {
+            auto inner = pool.submit([] { std::this_thread::sleep_for(std::chrono::milliseconds(10)); });
+            while (!inner.is_ready())
+                pool.try_run_one();
+        }).get();
+        // The outer job is recorded after its future got ready.
+        while (profiler.total().jobs_run != 2)
+            std::this_thread::yield();
+        pool.set_profiler(nullptr);
+
+        auto const total = profiler.total();
+        REQUIRE(total.busy == total.run_time.max);
+    }
+#endif
+}
+
+TEST_CASE("Job cancellation")
+{
+    using namespace std::chrono_literals;
+    auto const mode = GENERATE(thread_pool_mode::shared_queue, thread_pool_mode::work_stealing);
+
+    SECTION("Cancelled and expired jobs do not run")
+    {
+        thread_pool pool(1, mode);
+        std::latch gate(1);
+        auto blocker = pool.submit([&] { gate.wait(); });
+
+        std::stop_source group;
+        std::atomic_int ran = 0;
+        std::vector<job_future<int>> futures;
+        for (int i = 0; i < 100; ++i)
+        {
+            futures.push_back(pool.submit([&, i] {
+                ++ran;
+                return i;
+            }, job_cancellation{ group.get_token() }));
+        }
+        for (int i = 0; i < 20; ++i)
+            pool.run_detached([&] { ++ran; }, job_cancellation{ group.get_token() });
+        auto expired = pool.submit([&] {
+            ++ran;
+            return 1;
+        }, job_cancellation{ .token = {}, .deadline = std::chrono::steady_clock::now() + 1ms });
+        auto kept = pool.submit([] { return 7; }, job_cancellation{ .token = {}, .deadline = std::chrono::steady_clock::now() + 1h });
+        auto chained = futures[3].then(pool, [](int v) { return v * 2; });
+
+        // CHECK, the worker has to be released before leaving the section.
+        group.request_stop();
+        for (auto& f : futures)
+            CHECK((!f.valid() || (f.is_ready() && f.is_cancelled())));
+        CHECK_THROWS_AS(futures[0].get(), job_cancelled);
+        CHECK(pool.submit([] { return 1; }, job_cancellation{ group.get_token() }).is_cancelled());
+
+        std::this_thread::sleep_for(5ms);
+        gate.count_down();
+        blocker.get();
+        REQUIRE(kept.get() == 7);
+        REQUIRE_THROWS_AS(expired.get(), job_cancelled);
+        REQUIRE_THROWS_AS(chained.get(), job_cancelled);
+        REQUIRE(ran == 0);
+    }
+
+    SECTION("Cancelling releases the captures of queued jobs")
+    {
+        thread_pool pool(1, mode);
+        std::latch gate(1);
+        auto blocker = pool.submit([&] { gate.wait(); });
+
+        std::stop_source source;
+        auto const resource = std::make_shared<int>(5);
+        auto job = pool.submit([resource] { return *resource; }, job_cancellation{ source.get_token() });
+        // CHECK, the worker has to be released before leaving the section.
+        CHECK(resource.use_count() == 2);
+        source.request_stop();
+        CHECK(resource.use_count() == 1);
+
+        gate.count_down();
+        blocker.get();
+        REQUIRE(job.is_cancelled());
+    }
+
+    SECTION("Jobs dropped by the pool destructor are cancelled")
+    {
+        std::optional<job_future<int>> dropped;
+        {
+            thread_pool pool(0, mode);
+            std::stop_source source;
+            dropped = pool.submit([] { return 1; }, job_cancellation{ source.get_token() });
+        }
+        REQUIRE(dropped->is_ready());
+        REQUIRE(dropped->is_cancelled());
+    }
+
+    SECTION("Cancelling concurrently with running")
+    {
+        thread_pool pool(2, mode);
+        for (int repeat = 0; repeat < 10; ++repeat)
+        {
+            std::stop_source source;
+            std::atomic_int ran = 0;
+            std::vector<job_future<void>> futures;
+            for (int i = 0; i < 200; ++i)
+                futures.push_back(pool.submit([&] { ++ran; }, job_cancellation{ source.get_token() }));
+            source.request_stop();
+            int cancelled = 0;
+            for (auto& f : futures)
+            {
+                f.wait();
+                if (f.is_cancelled())
+                    ++cancelled;
+                else
+                    f.get();
+            }
+            REQUIRE(cancelled + ran == 200);
+        }
+    }
+}
+
+TEST_CASE("Buffered async resource")
+{
+    basic_thread_pool<int> pool([](unsigned) { return 3; }, 2);
+
+    SECTION("Snapshots stay valid while new values are published")
+    {
+        buffered_async_resource<std::vector<int>> resource(std::vector<int>{ 1, 2, 3 });
+        int sum = 0;
+        for (auto* value : resource.iterate())
+            sum += *value;
+        REQUIRE(sum == 6);
+
+        auto const snapshot = resource.current();
+        resource.publish(std::vector<int>(10, 10));
+        REQUIRE(snapshot->size() == 3);
+        REQUIRE(resource.current()->size() == 10);
+    }
+
+    SECTION("Readers never see torn values")
+    {
+        buffered_async_resource<std::vector<int>> resource;
+        std::atomic_bool stop = false;
+        std::atomic_int torn = 0;
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r)
+        {
+            readers.emplace_back([&] {
+                while (!stop)
+                {
+                    auto const snapshot = resource.current();
+                    for (auto v : *snapshot)
+                    {
+                        if (v != int(snapshot->size()))
+                            ++torn;
+                    }
+                }
+            });
+        }
+        for (int i = 1; i < 200; ++i)
+        {
+            while (!resource.load_resource(pool, [i](int&) { return std::vector<int>(i, i); }))
+                std::this_thread::yield();
+        }
+        resource.wait();
+        stop = true;
+        for (auto& reader : readers)
+            reader.join();
+        REQUIRE(torn == 0);
+        REQUIRE(resource.current()->size() == 199);
+        int size = 0;
+        resource.current([&](std::vector<int> const& v) { size = int(v.size()); });
+        REQUIRE(size == 199);
+    }
+
+    SECTION("Loading on construction")
+    {
+        buffered_async_resource<int, 2> resource(pool, [](int& data) { return 39 + data; });
+        resource.wait();
+        REQUIRE(resource.is_ready());
+        REQUIRE(*resource.current() == 42);
+    }
+}